@@ -0,0 +1,162 @@
+#include <linux/device.h>
+#include <linux/firmware.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "book.h"
+#include "game.h"
+
+static struct book_entry *entries;
+static u32 n_entries;
+static int book_size, book_goal;
+static u32 pow3[BOOK_MAX_GRIDS];
+
+/* sym_src[t][i] is the cell of the real board that lands on cell i of the
+ * board transformed by symmetry t (t = transpose << 2 | flip_row << 1 |
+ * flip_col).
+ */
+static u8 sym_src[8][BOOK_MAX_GRIDS];
+
+static void book_init_symmetries(int size)
+{
+    pow3[0] = 1;
+    for (int i = 1; i < size * size; i++)
+        pow3[i] = pow3[i - 1] * 3;
+
+    for (int t = 0; t < 8; t++) {
+        for (int i = 0; i < size * size; i++) {
+            int r = i / size, c = i % size;
+            if (t & 4)
+                swap(r, c);
+            if (t & 2)
+                r = size - 1 - r;
+            if (t & 1)
+                c = size - 1 - c;
+            sym_src[t][i] = r * size + c;
+        }
+    }
+}
+
+int book_init(struct device *dev, const char *name)
+{
+    const struct firmware *fw;
+    const struct book_header *hdr;
+    int ret;
+
+    ret = request_firmware(&fw, name, dev);
+    if (ret) {
+        pr_info("simrupt: no opening book (%s), searching every move\n",
+                name);
+        return ret;
+    }
+
+    ret = -EINVAL;
+    hdr = (const struct book_header *) fw->data;
+    if (fw->size < sizeof(*hdr) ||
+        memcmp(hdr->magic, BOOK_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != BOOK_VERSION) {
+        pr_warn("simrupt: %s is not a valid book\n", name);
+        goto out;
+    }
+    if (game_check_geometry(hdr->board_size, hdr->goal) ||
+        hdr->board_size * hdr->board_size > BOOK_MAX_GRIDS ||
+        hdr->allow_exceed != ALLOW_EXCEED) {
+        pr_warn("simrupt: %s has an unsupported geometry\n", name);
+        goto out;
+    }
+    n_entries = le32_to_cpu(hdr->n_entries);
+    if (fw->size != sizeof(*hdr) + (size_t) n_entries * sizeof(*entries)) {
+        pr_warn("simrupt: %s is truncated\n", name);
+        n_entries = 0;
+        goto out;
+    }
+
+    entries = kvmalloc_array(n_entries, sizeof(*entries), GFP_KERNEL);
+    if (!entries) {
+        n_entries = 0;
+        ret = -ENOMEM;
+        goto out;
+    }
+    memcpy(entries, fw->data + sizeof(*hdr), n_entries * sizeof(*entries));
+    /* book_probe() bisects the keys and indexes the board with the moves */
+    for (u32 i = 0; i < n_entries; i++) {
+        if (entries[i].move >= hdr->board_size * hdr->board_size ||
+            (i && le32_to_cpu(entries[i].key) <=
+                      le32_to_cpu(entries[i - 1].key))) {
+            pr_warn("simrupt: %s has an invalid entry %u\n", name, i);
+            kvfree(entries);
+            entries = NULL;
+            n_entries = 0;
+            goto out;
+        }
+    }
+    book_size = hdr->board_size;
+    book_goal = hdr->goal;
+    book_init_symmetries(book_size);
+    pr_info("simrupt: loaded %u book positions for %dx%d goal %d from %s\n",
+            n_entries, book_size, book_size, book_goal, name);
+    ret = 0;
+out:
+    release_firmware(fw);
+    return ret;
+}
+
+void book_exit(void)
+{
+    kvfree(entries);
+    entries = NULL;
+    n_entries = 0;
+}
+
+/* Return the book move for @player on @table, or -1 if the position is not
+ * covered, the book was generated for another geometry or its move is taken.
+ */
+int book_probe(const char *table, char player)
+{
+    u32 key = U32_MAX, lo = 0, hi = n_entries;
+    int n_x = 0, n_o = 0, sym = 0;
+
+    if (!n_entries || BOARD_SIZE != book_size || GOAL != book_goal)
+        return -1;
+
+    /* The book only knows positions reached with 'X' moving first */
+    for (int i = 0; i < N_GRIDS; i++) {
+        n_x += table[i] == 'X';
+        n_o += table[i] == 'O';
+    }
+    if (player != (n_x == n_o ? 'X' : 'O'))
+        return -1;
+
+    for (int t = 0; t < 8; t++) {
+        u32 k = 0;
+        for (int i = 0; i < N_GRIDS; i++) {
+            char v = table[sym_src[t][i]];
+            k += pow3[i] * (v == 'X' ? 1 : v == 'O' ? 2 : 0);
+        }
+        if (k < key) {
+            key = k;
+            sym = t;
+        }
+    }
+
+    while (lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        u32 k = le32_to_cpu(entries[mid].key);
+        if (k == key) {
+            int move = sym_src[sym][entries[mid].move];
+
+            /* Let the engines search rather than play on a stone */
+            return table[move] == ' ' ? move : -1;
+        }
+        if (k < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -1;
+}
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <linux/types.h>
+
+/* On-disk layout of the opening book / endgame tablebase produced by
+ * tools/gen-book. All multi-byte fields are little-endian. The header is
+ * followed by n_entries entries sorted by key.
+ */
+#define BOOK_MAGIC "SRBK"
+#define BOOK_VERSION 1
+#define BOOK_MAX_GRIDS 16 /* keys are base-3 encodings packed in 32 bits */
+#define BOOK_WIN 100      /* score of a position won on the next move */
+#define BOOK_FIRMWARE "simrupt-book.bin"
+
+struct book_header {
+    char magic[4];
+    __u8 version;
+    __u8 board_size;
+    __u8 goal;
+    __u8 allow_exceed;
+    __le32 n_entries;
+};
+
+struct book_entry {
+    __le32 key;
+    __u8 move;
+    __s8 score; /* > 0: side to move wins, < 0: loses, 0: draw */
+    __u8 reserved[2];
+};
+
+#ifdef __KERNEL__
+struct device;
+
+int book_init(struct device *dev, const char *name);
+void book_exit(void);
+int book_probe(const char *table, char player);
+#endif
@@ -0,0 +1,243 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#ifdef __KERNEL__
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#endif
+
+#include "cache.h"
+#include "game.h"
+#include "zobrist.h"
+
+/* Results of pns_solve(), kept across games and, through the exported blob,
+ * across module reloads. Unlike the proof table it holds only solved
+ * positions, one small entry each, so the whole table fits in the blob.
+ */
+#define O_TO_MOVE 0x5bd1e9955bd1e995ULL
+
+static struct cache_entry entries[CACHE_SIZE];
+static struct game_geometry cache_geometry;
+
+/* Serializes the engines against debugfs readers and writers */
+static DEFINE_MUTEX(cache_lock);
+
+/* Set by a valid header, for the entries written after it */
+static bool importing;
+
+struct cache_stats cache_stats;
+
+static inline u64 cache_key(char player, u64 hash)
+{
+    return player == 'O' ? hash ^ O_TO_MOVE : hash;
+}
+
+static inline struct cache_entry *slot_of(u64 key)
+{
+    return &entries[key & (CACHE_SIZE - 1)];
+}
+
+/* Called with cache_lock held: drop the results of another geometry */
+static void check_geometry(void)
+{
+    if (cache_geometry.size == BOARD_SIZE && cache_geometry.goal == GOAL)
+        return;
+    memset(entries, 0, sizeof(entries));
+    cache_geometry = geometry;
+}
+
+/* Value of @player to move on @table, whose stones hash to @hash, and the
+ * move that achieves it, or PNS_UNKNOWN if the position is not cached.
+ */
+enum pns_value cache_probe(const char *table,
+                           char player,
+                           u64 hash,
+                           int *move)
+{
+    u64 key = cache_key(player, hash);
+    enum pns_value value = PNS_UNKNOWN;
+    struct cache_entry *e;
+
+    mutex_lock(&cache_lock);
+    check_geometry();
+    e = slot_of(key);
+    if (le64_to_cpu(e->key) == key && e->value != PNS_UNKNOWN &&
+        e->value <= PNS_LOSS && e->move < N_GRIDS && table[e->move] == ' ') {
+        value = e->value;
+        *move = e->move;
+    }
+    mutex_unlock(&cache_lock);
+
+    if (value == PNS_UNKNOWN)
+        cache_stats.misses++;
+    else
+        cache_stats.hits++;
+    return value;
+}
+
+void cache_store(char player, u64 hash, int move, enum pns_value value)
+{
+    u64 key = cache_key(player, hash);
+    struct cache_entry *e;
+
+    mutex_lock(&cache_lock);
+    check_geometry();
+    e = slot_of(key);
+    e->key = cpu_to_le64(key);
+    e->move = move;
+    e->value = value;
+    mutex_unlock(&cache_lock);
+    cache_stats.stores++;
+}
+
+static void fill_header(struct cache_header *hdr)
+{
+    memcpy(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic));
+    hdr->version = CACHE_VERSION;
+    hdr->board_size = cache_geometry.size;
+    hdr->goal = cache_geometry.goal;
+    hdr->allow_exceed = ALLOW_EXCEED;
+    hdr->n_entries = cpu_to_le32(CACHE_SIZE);
+    hdr->key_check = cpu_to_le32((u32) zobrist_table[0][0]);
+}
+
+/* Forget every solved position */
+void cache_clear(void)
+{
+    mutex_lock(&cache_lock);
+    memset(entries, 0, sizeof(entries));
+    importing = false;
+    mutex_unlock(&cache_lock);
+}
+
+/* Copy @count bytes of the blob from @off to @buf, returning the number of
+ * bytes copied. The header describes the geometry of the entries as they
+ * are: reading the blob never drops them.
+ */
+size_t cache_export(void *buf, size_t off, size_t count)
+{
+    struct cache_header hdr;
+    size_t done = 0;
+
+    if (off >= CACHE_BLOB_SIZE)
+        return 0;
+    count = min(count, CACHE_BLOB_SIZE - off);
+
+    mutex_lock(&cache_lock);
+    /* A cache never used yet is empty, and so valid for the current one */
+    if (!cache_geometry.size)
+        cache_geometry = geometry;
+    if (off < sizeof(hdr)) {
+        fill_header(&hdr);
+        done = min(count, sizeof(hdr) - off);
+        memcpy(buf, (char *) &hdr + off, done);
+    }
+    if (done < count)
+        memcpy((char *) buf + done,
+               (char *) entries + off + done - sizeof(hdr), count - done);
+    mutex_unlock(&cache_lock);
+    return count;
+}
+
+/* Write @count bytes of a blob at @off. The header must come first, in one
+ * piece, and replaces the whole cache if it was exported for the current
+ * geometry by the same version of the module.
+ */
+ssize_t cache_import(const void *buf, size_t off, size_t count)
+{
+    struct cache_header hdr, want;
+    ssize_t ret = count;
+
+    if (off >= CACHE_BLOB_SIZE || count > CACHE_BLOB_SIZE - off)
+        return -EFBIG;
+
+    mutex_lock(&cache_lock);
+    if (!off) {
+        importing = false;
+        if (count < sizeof(hdr)) {
+            ret = -EINVAL;
+            goto out;
+        }
+        memcpy(&hdr, buf, sizeof(hdr));
+        check_geometry();
+        fill_header(&want);
+        if (memcmp(&hdr, &want, sizeof(hdr))) {
+            ret = -EINVAL;
+            goto out;
+        }
+        memset(entries, 0, sizeof(entries));
+        importing = true;
+        buf = (const char *) buf + sizeof(hdr);
+        off = sizeof(hdr);
+        count -= sizeof(hdr);
+    } else if (!importing || off < sizeof(hdr)) {
+        ret = -EINVAL;
+        goto out;
+    }
+    memcpy((char *) entries + off - sizeof(hdr), buf, count);
+out:
+    mutex_unlock(&cache_lock);
+    return ret;
+}
+
+#ifdef __KERNEL__
+/* /sys/kernel/debug/simrupt/cache: read to save the cache, write it back
+ * after loading the module.
+ */
+static ssize_t cache_read(struct file *file,
+                          char __user *ubuf,
+                          size_t count,
+                          loff_t *ppos)
+{
+    size_t len;
+    void *buf;
+
+    if (*ppos < 0)
+        return -EINVAL;
+    if (*ppos >= CACHE_BLOB_SIZE)
+        return 0;
+    buf = kmalloc(min_t(size_t, count, PAGE_SIZE), GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+    len = cache_export(buf, *ppos, min_t(size_t, count, PAGE_SIZE));
+    if (copy_to_user(ubuf, buf, len)) {
+        kfree(buf);
+        return -EFAULT;
+    }
+    kfree(buf);
+    *ppos += len;
+    return len;
+}
+
+static ssize_t cache_write(struct file *file,
+                           const char __user *ubuf,
+                           size_t count,
+                           loff_t *ppos)
+{
+    ssize_t ret;
+    void *buf;
+
+    if (*ppos < 0)
+        return -EINVAL;
+    count = min_t(size_t, count, PAGE_SIZE);
+    buf = memdup_user(ubuf, count);
+    if (IS_ERR(buf))
+        return PTR_ERR(buf);
+    ret = cache_import(buf, *ppos, count);
+    kfree(buf);
+    if (ret > 0)
+        *ppos += ret;
+    return ret;
+}
+
+const struct file_operations cache_fops = {
+    .owner = THIS_MODULE,
+    .read = cache_read,
+    .write = cache_write,
+    .llseek = default_llseek,
+};
+#endif
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <linux/types.h>
+
+#include "pns.h"
+
+/* Layout of the solved-position cache as exported and imported through
+ * debugfs: the header followed by n_entries entries, the table itself. All
+ * multi-byte fields are little-endian.
+ */
+#define CACHE_MAGIC "SRSC"
+#define CACHE_VERSION 1
+#define CACHE_SIZE (1 << 14) /* entries, a power of two */
+
+struct cache_header {
+    char magic[4];
+    __u8 version;
+    __u8 board_size;
+    __u8 goal;
+    __u8 allow_exceed;
+    __le32 n_entries;
+    __le32 key_check; /* low bits of the first Zobrist key */
+};
+
+struct cache_entry {
+    __le64 key; /* Zobrist key of the stones and the side to move */
+    __u8 move;
+    __u8 value; /* enum pns_value, PNS_UNKNOWN for an empty slot */
+    __u8 reserved[6];
+};
+
+#define CACHE_BLOB_SIZE \
+    (sizeof(struct cache_header) + CACHE_SIZE * sizeof(struct cache_entry))
+
+struct cache_stats {
+    unsigned long hits, misses, stores;
+};
+
+extern struct cache_stats cache_stats;
+
+enum pns_value cache_probe(const char *table,
+                           char player,
+                           u64 hash,
+                           int *move);
+void cache_store(char player, u64 hash, int move, enum pns_value value);
+void cache_clear(void);
+size_t cache_export(void *buf, size_t off, size_t count);
+ssize_t cache_import(const void *buf, size_t off, size_t count);
+
+#ifdef __KERNEL__
+extern const struct file_operations cache_fops;
+#endif
@@ -0,0 +1,97 @@
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/string.h>
+
+#include "engine.h"
+
+/* Registry of the engines, indexed by ENGINE_*. Later engines may depend on
+ * the initialization of earlier ones.
+ */
+const struct engine_ops *const engines[NR_ENGINES] = {
+    [ENGINE_MCTS] = &mcts_engine,
+    [ENGINE_NEGAMAX] = &negamax_engine,
+    [ENGINE_PNS] = &pns_engine,
+};
+
+/* Counters kept for every engine by engine_search() */
+static struct {
+    unsigned long searches;
+    u64 time_ns;
+} clocks[NR_ENGINES];
+
+/* ENGINE_* of @name, a trailing newline allowed, or -EINVAL */
+int engine_find(const char *name)
+{
+    for (int i = 0; i < NR_ENGINES; i++)
+        if (sysfs_streq(name, engines[i]->name))
+            return i;
+    return -EINVAL;
+}
+
+/* An engine whose tables cannot be allocated still plays, without them */
+void engines_init(void)
+{
+    for (int i = 0; i < NR_ENGINES; i++) {
+        int ret = engines[i]->init ? engines[i]->init() : 0;
+
+        if (ret)
+            pr_warn("simrupt: %s engine initialization failed (%d)\n",
+                    engines[i]->name, ret);
+    }
+}
+
+void engines_exit(void)
+{
+    for (int i = NR_ENGINES - 1; i >= 0; i--)
+        if (engines[i]->exit)
+            engines[i]->exit();
+}
+
+void engines_reset(void)
+{
+    for (int i = 0; i < NR_ENGINES; i++)
+        if (engines[i]->reset)
+            engines[i]->reset();
+}
+
+void engines_clear(void)
+{
+    engines_reset();
+    for (int i = 0; i < NR_ENGINES; i++)
+        if (engines[i]->clear)
+            engines[i]->clear();
+}
+
+/* ENGINE_* of the fallback of @engine, or -1 */
+int engine_fallback(int engine)
+{
+    for (int i = 0; i < NR_ENGINES; i++)
+        if (engines[i] == engines[engine]->fallback)
+            return i;
+    return -1;
+}
+
+int engine_search(int engine,
+                  char *table,
+                  char player,
+                  int budget,
+                  const bool *stop)
+{
+    u64 start = ktime_get_ns();
+    int move = engines[engine]->search(table, player, budget, stop);
+
+    clocks[engine].searches++;
+    clocks[engine].time_ns += ktime_get_ns() - start;
+    return move;
+}
+
+void engine_counters(int engine, struct engine_counters *c)
+{
+    memset(c, 0, sizeof(*c));
+    engines[engine]->counters(c);
+    c->searches = clocks[engine].searches;
+    c->time_ns = clocks[engine].time_ns;
+}
+
+MODULE_LICENSE("GPL");
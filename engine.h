@@ -0,0 +1,66 @@
+#pragma once
+
+#include <linux/types.h>
+
+enum {
+    ENGINE_MCTS,
+    ENGINE_NEGAMAX,
+    ENGINE_PNS,
+    NR_ENGINES,
+};
+
+/* Counters every engine reports, cumulative except for memory */
+struct engine_counters {
+    unsigned long searches; /* moves searched */
+    unsigned long nodes;    /* MCTS iterations, negamax or pns positions */
+    unsigned long rollouts; /* random playouts */
+    u64 time_ns;            /* spent in search */
+    size_t memory;          /* bytes of tables and trees held now */
+};
+
+/* Interface of a search engine. All engines keep global state: calls to one
+ * engine must not overlap, and ponder must be stopped before search.
+ */
+struct engine_ops {
+    const char *name;
+    int budget; /* default budget of search and ponder */
+    int (*init)(void);
+    void (*exit)(void);
+    /* Move of @player on @table within @budget, or -1 */
+    int (*search)(char *table, char player, int budget, const bool *stop);
+    /* Notified of its own move: search on the time of @player, the
+     * opponent, until @stop. Optional.
+     */
+    void (*ponder)(const char *table,
+                   char player,
+                   int budget,
+                   const bool *stop);
+    /* Forget what was learnt about the game being played. Optional. */
+    void (*reset)(void);
+    /* Also forget what is kept across games, so that a run does not depend
+     * on earlier ones. Optional.
+     */
+    void (*clear)(void);
+    /* Fill nodes, rollouts and memory */
+    void (*counters)(struct engine_counters *c);
+    /* Engine whose search this one may run, so whose ponder must be
+     * stopped as well. Optional.
+     */
+    const struct engine_ops *fallback;
+};
+
+extern const struct engine_ops mcts_engine, negamax_engine, pns_engine;
+extern const struct engine_ops *const engines[NR_ENGINES];
+
+int engine_find(const char *name);
+void engines_init(void);
+void engines_exit(void);
+void engines_reset(void);
+void engines_clear(void);
+int engine_fallback(int engine);
+int engine_search(int engine,
+                  char *table,
+                  char player,
+                  int budget,
+                  const bool *stop);
+void engine_counters(int engine, struct engine_counters *c);
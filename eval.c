@@ -0,0 +1,63 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+
+#include "eval.h"
+#include "game.h"
+
+/* Cap on the score of one segment, so that the sum over the 1024 segments of
+ * a 16x16 board stays below negamax's SCORE_INF. Only goals above 7 reach it.
+ */
+#define PATTERN_SCORE_MAX 1000000
+
+int pattern_score[N_PATTERNS];
+u16 cell_segments[N_GRIDS_MAX][CELL_SEGMENTS_MAX];
+u8 n_cell_segments[N_GRIDS_MAX];
+
+static int n_segments;
+
+static int stones_score(int n)
+{
+    int score = 1;
+
+    for (int k = 1; k < n && score < PATTERN_SCORE_MAX; k++)
+        score *= 10;
+    return min(score, PATTERN_SCORE_MAX);
+}
+
+/* Called by game_configure() once lines[] describe the new geometry */
+void eval_configure(void)
+{
+    memset(pattern_score, 0, sizeof(pattern_score));
+    for (int n = 1; n <= GOAL; n++) {
+        pattern_score[n * EVAL_X] = stones_score(n);
+        pattern_score[n] = -stones_score(n);
+    }
+
+    n_segments = 0;
+    memset(n_cell_segments, 0, sizeof(n_cell_segments));
+    for (int d = 0; d < 4; d++) {
+        line_t line = lines[d];
+        for (int i = line.i_lower_bound; i < line.i_upper_bound; ++i) {
+            for (int j = line.j_lower_bound; j < line.j_upper_bound; ++j) {
+                for (int k = 0; k < GOAL; k++) {
+                    int cell = GET_INDEX(i + k * line.i_shift,
+                                         j + k * line.j_shift);
+                    cell_segments[cell][n_cell_segments[cell]++] = n_segments;
+                }
+                n_segments++;
+            }
+        }
+    }
+}
+
+void eval_init(struct eval_state *s, const char *table)
+{
+    s->score = 0;
+    memset(s->pattern, 0, n_segments * sizeof(*s->pattern));
+    for (int i = 0; i < N_GRIDS; i++)
+        if (table[i] != ' ')
+            eval_place(s, i, table[i]);
+}
+
+MODULE_LICENSE("GPL");
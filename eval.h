@@ -0,0 +1,54 @@
+#pragma once
+
+#include <linux/types.h>
+
+#include "game.h"
+
+/* Pattern evaluation. Every segment of GOAL cells in a line scores 10^(n-1)
+ * for n stones of one player and none of the other, from that player's point
+ * of view. The score only depends on the two counts, so a segment's pattern
+ * is packed as n_x * EVAL_X + n_o, and the sum over all segments is kept up
+ * to date as stones are placed and removed.
+ */
+#define EVAL_X (BOARD_SIZE_MAX + 1)
+#define N_PATTERNS (EVAL_X * EVAL_X)
+#define N_SEGMENTS_MAX (4 * N_GRIDS_MAX)
+#define CELL_SEGMENTS_MAX (4 * BOARD_SIZE_MAX)
+
+/* Tables of the configured geometry, filled by eval_configure() */
+extern int pattern_score[N_PATTERNS]; /* score for X */
+extern u16 cell_segments[N_GRIDS_MAX][CELL_SEGMENTS_MAX];
+extern u8 n_cell_segments[N_GRIDS_MAX];
+
+struct eval_state {
+    int score; /* for X */
+    u16 pattern[N_SEGMENTS_MAX];
+};
+
+void eval_configure(void);
+void eval_init(struct eval_state *s, const char *table);
+
+static inline void eval_update(struct eval_state *s, int cell, int delta)
+{
+    for (int k = 0; k < n_cell_segments[cell]; k++) {
+        u16 *p = &s->pattern[cell_segments[cell][k]];
+        s->score -= pattern_score[*p];
+        *p += delta;
+        s->score += pattern_score[*p];
+    }
+}
+
+static inline void eval_place(struct eval_state *s, int cell, char player)
+{
+    eval_update(s, cell, player == 'X' ? EVAL_X : 1);
+}
+
+static inline void eval_remove(struct eval_state *s, int cell, char player)
+{
+    eval_update(s, cell, player == 'X' ? -EVAL_X : -1);
+}
+
+static inline int eval_score(const struct eval_state *s, char player)
+{
+    return player == 'X' ? s->score : -s->score;
+}
@@ -1,30 +1,73 @@
 #include <linux/ctype.h>
+#include <linux/errno.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/string.h>
 
+#include "eval.h"
 #include "game.h"
 
 #define frac_bits 16
-#define LOOKUP(table, i, j, else_value)                         \
-    ((i) < 0 || (j) < 0 || (i) > BOARD_SIZE || (j) > BOARD_SIZE \
-         ? (else_value)                                         \
+#define LOOKUP(table, i, j, else_value)                           \
+    ((i) < 0 || (j) < 0 || (i) >= BOARD_SIZE || (j) >= BOARD_SIZE \
+         ? (else_value)                                           \
          : (table)[GET_INDEX(i, j)])
 
-_Static_assert(BOARD_SIZE <= 26, "Board size must not be greater than 26");
-_Static_assert(BOARD_SIZE > 0, "Board size must be greater than 0");
-_Static_assert(GOAL <= BOARD_SIZE, "Goal must not be greater than board size");
-_Static_assert(GOAL > 0, "Goal must be greater than 0");
+_Static_assert(BOARD_SIZE_MAX <= 26, "Board size must not be greater than 26");
 _Static_assert(ALLOW_EXCEED == 0 || ALLOW_EXCEED == 1,
                "ALLOW_EXCEED must be a boolean that is 0 or 1");
 
-const line_t lines[4] = {
-    {1, 0, 0, 0, BOARD_SIZE - GOAL + 1, BOARD_SIZE},             // ROW
-    {0, 1, 0, 0, BOARD_SIZE, BOARD_SIZE - GOAL + 1},             // COL
-    {1, 1, 0, 0, BOARD_SIZE - GOAL + 1, BOARD_SIZE - GOAL + 1},  // PRIMARY
-    {1, -1, 0, GOAL - 1, BOARD_SIZE - GOAL + 1, BOARD_SIZE},     // SECONDARY
-};
+struct game_geometry geometry;
+line_t lines[4];
+
+/* Bitboard kernel: start_mask[d] has a bit for every cell a winning segment
+ * in direction d can start from, shift[d] is the index distance between two
+ * consecutive cells of that segment.
+ */
+static u64 start_mask[4];
+static int shift[4];
+static u64 full_mask;
+
+int game_check_geometry(int size, int goal)
+{
+    if (size <= 0 || size > BOARD_SIZE_MAX || goal <= 0 || goal > size)
+        return -EINVAL;
+    return 0;
+}
+
+int game_configure(int size, int goal)
+{
+    int span;
+
+    if (game_check_geometry(size, goal))
+        return -EINVAL;
+
+    span = size - goal + 1;
+    geometry.size = size;
+    geometry.goal = goal;
+    geometry.n_grids = size * size;
+    geometry.bitboard = ALLOW_EXCEED && geometry.n_grids <= 64;
+
+    lines[0] = (line_t){1, 0, 0, 0, span, size};          // ROW
+    lines[1] = (line_t){0, 1, 0, 0, size, span};          // COL
+    lines[2] = (line_t){1, 1, 0, 0, span, span};          // PRIMARY
+    lines[3] = (line_t){1, -1, 0, goal - 1, span, size};  // SECONDARY
+    eval_configure();
+
+    if (!geometry.bitboard)
+        return 0;
+    full_mask = ~0ULL >> (64 - geometry.n_grids);
+    for (int d = 0; d < 4; d++) {
+        line_t line = lines[d];
+        start_mask[d] = 0;
+        shift[d] = line.i_shift * size + line.j_shift;
+        for (int i = line.i_lower_bound; i < line.i_upper_bound; ++i)
+            for (int j = line.j_lower_bound; j < line.j_upper_bound; ++j)
+                start_mask[d] |= 1ULL << GET_INDEX(i, j);
+    }
+    return 0;
+}
 
 static char check_line_segment_win(const char *t, int i, int j, line_t line)
 {
@@ -45,8 +88,38 @@ static char check_line_segment_win(const char *t, int i, int j, line_t line)
     return last;
 }
 
+static inline bool bitboard_win(u64 b)
+{
+    for (int d = 0; d < 4; d++) {
+        u64 m = b & start_mask[d];
+        for (int k = 1; k < GOAL && m; k++)
+            m &= b >> (k * shift[d]);
+        if (m)
+            return true;
+    }
+    return false;
+}
+
+static char check_win_bitboard(const char *t)
+{
+    u64 x = 0, o = 0;
+
+    for (int i = 0; i < N_GRIDS; i++) {
+        x |= (u64) (t[i] == 'X') << i;
+        o |= (u64) (t[i] == 'O') << i;
+    }
+    if (bitboard_win(x))
+        return 'X';
+    if (bitboard_win(o))
+        return 'O';
+    return (x | o) == full_mask ? 'D' : ' ';
+}
+
 char check_win(char *t)
 {
+    if (geometry.bitboard)
+        return check_win_bitboard(t);
+
     for (int i_line = 0; i_line < 4; ++i_line) {
         line_t line = lines[i_line];
         for (int i = line.i_lower_bound; i < line.i_upper_bound; ++i) {
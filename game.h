@@ -1,9 +1,27 @@
 #pragma once
 
-#define BOARD_SIZE 4
-#define GOAL 3
+#include <linux/kernel.h>
+#include <linux/types.h>
+
+#define BOARD_SIZE_MAX 16
+#define N_GRIDS_MAX (BOARD_SIZE_MAX * BOARD_SIZE_MAX)
+#define DEFAULT_BOARD_SIZE 4
+#define DEFAULT_GOAL 3
 #define ALLOW_EXCEED 1
-#define N_GRIDS (BOARD_SIZE * BOARD_SIZE)
+
+/* Geometry of the board being played, set by game_configure() between
+ * games. Boards of at most 64 cells are also checked with bitboards.
+ */
+struct game_geometry {
+    int size, goal, n_grids;
+    bool bitboard;
+};
+
+extern struct game_geometry geometry;
+
+#define BOARD_SIZE (geometry.size)
+#define GOAL (geometry.goal)
+#define N_GRIDS (geometry.n_grids)
 #define GET_INDEX(i, j) ((i) * (BOARD_SIZE) + (j))
 #define GET_COL(x) ((x) % BOARD_SIZE)
 #define GET_ROW(x) ((x) / BOARD_SIZE)
@@ -17,8 +35,18 @@ typedef struct {
     int i_lower_bound, j_lower_bound, i_upper_bound, j_upper_bound;
 } line_t;
 
-extern const line_t lines[4];
+extern line_t lines[4];
+
+/* Cancellation token of a search, which unwinds once *stop becomes true. A
+ * NULL token never stops.
+ */
+static inline bool search_stopped(const bool *stop)
+{
+    return stop && READ_ONCE(*stop);
+}
 
+int game_check_geometry(int size, int goal);
+int game_configure(int size, int goal);
 int *available_moves(const char *table);
 char check_win(char *t);
 unsigned long calculate_win_value(char win, char player);
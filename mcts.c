@@ -1,42 +1,57 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
-#include <linux/random.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/string.h>
 
+#include "engine.h"
 #include "game.h"
 #include "mcts.h"
-#include "util.h"
+#include "xoroshiro128.h"
 
 #define frac_bits 16
 
+struct mcts_stats mcts_stats;
+
+/* MCTS-Solver: game-theoretic value of a node for the player who moved into
+ * it, like its score. Proven nodes are scored exactly instead of searched.
+ */
+enum { UNPROVEN, PROVEN_WIN, PROVEN_DRAW, PROVEN_LOSS };
+
 struct node {
     int move;
     char player;
+    char proven;
     int n_visits;
     unsigned long score;
     struct node *parent;
-    struct node *children[N_GRIDS];
+    int n_children;
+    struct node **children; /* NULL until expanded */
 };
 
 static struct node *new_node(int move, char player, struct node *parent)
 {
     struct node *node = kmalloc(sizeof(struct node), GFP_KERNEL);
+    mcts_stats.nodes++;
+    mcts_stats.live_nodes++;
     node->move = move;
     node->player = player;
+    node->proven = UNPROVEN;
     node->n_visits = 0;
     node->score = 0;
     node->parent = parent;
-    memset(node->children, 0, sizeof(node->children));
+    node->n_children = 0;
+    node->children = NULL;
     return node;
 }
 
 static void free_node(struct node *node)
 {
-    for (int i = 0; i < N_GRIDS; i++)
-        if (node->children[i])
-            free_node(node->children[i]);
+    for (int i = 0; i < node->n_children; i++)
+        free_node(node->children[i]);
+    kfree(node->children);
     kfree(node);
+    mcts_stats.live_nodes--;
 }
 
 static unsigned long fixed_mul(unsigned long a, unsigned long b)
@@ -116,8 +131,9 @@ static struct node *select_move(struct node *node)
 {
     struct node *best_node = NULL;
     unsigned long best_score = 0;
-    for (int i = 0; i < N_GRIDS; i++) {
-        if (!node->children[i])
+    for (int i = 0; i < node->n_children; i++) {
+        /* Never worth playing again */
+        if (node->children[i]->proven == PROVEN_LOSS)
             continue;
         unsigned long score =
             uct_score(node->n_visits, node->children[i]->n_visits,
@@ -128,15 +144,8 @@ static struct node *select_move(struct node *node)
         }
     }
 
-    if (!best_node) {
-        while (1) {
-            unsigned long rand_num;
-            get_random_bytes(&rand_num, sizeof(rand_num));
-            best_node = node->children[rand_num % N_GRIDS];
-            if (best_node)
-                break;
-        }
-    }
+    if (!best_node)
+        best_node = node->children[xoro_next() % node->n_children];
 
     return best_node;
 }
@@ -144,7 +153,8 @@ static struct node *select_move(struct node *node)
 static unsigned long simulate(char *table, char player)
 {
     char current_player = player;
-    char temp_table[N_GRIDS];
+    char temp_table[N_GRIDS_MAX];
+    mcts_stats.rollouts++;
     memcpy(temp_table, table, N_GRIDS);
     while (1) {
         char win;
@@ -156,9 +166,7 @@ static unsigned long simulate(char *table, char player)
         int n_moves = 0;
         while (n_moves < N_GRIDS && moves[n_moves] != -1)
             ++n_moves;
-        unsigned long rand_num;
-        get_random_bytes(&rand_num, sizeof(rand_num));
-        int move = moves[rand_num % n_moves];
+        int move = moves[xoro_next() % n_moves];
         kfree(moves);
         temp_table[move] = current_player;
         if ((win = check_win(temp_table)) != ' ')
@@ -178,53 +186,217 @@ static void backpropagate(struct node *node, unsigned long score)
     }
 }
 
+static unsigned long proven_score(const struct node *node)
+{
+    if (node->proven == PROVEN_WIN)
+        return 1U << frac_bits;
+    if (node->proven == PROVEN_DRAW)
+        return 1U << (frac_bits - 1);
+    return 0;
+}
+
+/* @node was just proven: prove the ancestors whose value follows from it. A
+ * winning move proves its parent lost, otherwise the parent is proven once
+ * all of its moves are.
+ */
+static void solve_up(struct node *node)
+{
+    struct node *parent;
+
+    for (; (parent = node->parent); node = parent) {
+        char best = PROVEN_LOSS; /* for the player to move at parent */
+
+        if (node->proven == PROVEN_WIN) {
+            parent->proven = PROVEN_LOSS;
+            continue;
+        }
+        for (int i = 0; i < parent->n_children; i++) {
+            char proven = parent->children[i]->proven;
+            if (proven == UNPROVEN)
+                return;
+            if (proven == PROVEN_DRAW)
+                best = PROVEN_DRAW;
+        }
+        parent->proven = best == PROVEN_DRAW ? PROVEN_DRAW : PROVEN_WIN;
+    }
+}
+
 static void expand(struct node *node, char *table)
 {
     int *moves = available_moves(table);
     int n_moves = 0;
     while (n_moves < N_GRIDS && moves[n_moves] != -1)
         ++n_moves;
+    node->children = kmalloc_array(n_moves, sizeof(struct node *), GFP_KERNEL);
     for (int i = 0; i < n_moves; i++) {
         node->children[i] = new_node(moves[i], node->player ^ 'O' ^ 'X', node);
     }
+    node->n_children = n_moves;
     kfree(moves);
 }
 
-int mcts(char *table, char player)
+static void iterate(struct node *root, const char *table)
 {
     char win;
-    struct node *root = new_node(-1, player, NULL);
-    for (int i = 0; i < ITERATIONS; i++) {
-        struct node *node = root;
-        char temp_table[N_GRIDS];
-        memcpy(temp_table, table, N_GRIDS);
-        while (1) {
-            if ((win = check_win(temp_table)) != ' ') {
-                unsigned long score =
-                    calculate_win_value(win, node->player ^ 'O' ^ 'X');
-                backpropagate(node, score);
-                break;
-            }
-            if (node->n_visits == 0) {
-                unsigned long score = simulate(temp_table, node->player);
-                backpropagate(node, score);
-                break;
-            }
-            if (node->children[0] == NULL)
-                expand(node, temp_table);
-            node = select_move(node);
-            // assert(node);
-            temp_table[node->move] = node->player ^ 'O' ^ 'X';
+    struct node *node = root;
+    char temp_table[N_GRIDS_MAX];
+    mcts_stats.iterations++;
+    memcpy(temp_table, table, N_GRIDS);
+    while (1) {
+        if (node->proven) {
+            backpropagate(node, proven_score(node));
+            break;
+        }
+        if ((win = check_win(temp_table)) != ' ') {
+            unsigned long score =
+                calculate_win_value(win, node->player ^ 'O' ^ 'X');
+            node->proven = win == 'D' ? PROVEN_DRAW : PROVEN_WIN;
+            solve_up(node);
+            backpropagate(node, score);
+            break;
+        }
+        if (node->n_visits == 0) {
+            unsigned long score = simulate(temp_table, node->player);
+            backpropagate(node, score);
+            break;
         }
+        if (!node->children)
+            expand(node, temp_table);
+        node = select_move(node);
+        // assert(node);
+        temp_table[node->move] = node->player ^ 'O' ^ 'X';
     }
-    struct node *best_node = NULL;
-    int most_visits = -1;
-    for (int i = 0; i < N_GRIDS; i++) {
-        if (root->children[i] && root->children[i]->n_visits > most_visits) {
-            most_visits = root->children[i]->n_visits;
-            best_node = root->children[i];
+}
+
+/* Tree grown by mcts_ponder() while the opponent, to move at its root, is
+ * thinking.
+ */
+static struct node *ponder_root;
+static char ponder_table[N_GRIDS_MAX];
+static struct game_geometry ponder_geometry;
+
+void mcts_ponder_reset(void)
+{
+    if (ponder_root)
+        free_node(ponder_root);
+    ponder_root = NULL;
+}
+
+void mcts_ponder(const char *table,
+                 char player,
+                 int iterations,
+                 const bool *stop)
+{
+    mcts_ponder_reset();
+    memcpy(ponder_table, table, N_GRIDS);
+    ponder_geometry = geometry;
+    ponder_root = new_node(-1, player, NULL);
+    for (int i = 0;
+         i < iterations && !ponder_root->proven && !search_stopped(stop);
+         i++) {
+        iterate(ponder_root, ponder_table);
+        mcts_stats.ponder_iterations++;
+        if (!(i & 63))
+            cond_resched();
+    }
+}
+
+/* Detach the subtree of the pondered position that matches the opponent's
+ * actual reply, and drop the rest of the tree.
+ */
+static struct node *ponder_take(const char *table, char player)
+{
+    struct node *root = NULL;
+
+    if (!ponder_root || ponder_root->player == player ||
+        ponder_geometry.size != BOARD_SIZE || ponder_geometry.goal != GOAL)
+        goto out;
+
+    for (int i = 0; i < ponder_root->n_children; i++) {
+        struct node *child = ponder_root->children[i];
+        ponder_table[child->move] = ponder_root->player;
+        if (!memcmp(ponder_table, table, N_GRIDS)) {
+            root = child;
+            root->parent = NULL;
+            ponder_root->children[i] =
+                ponder_root->children[--ponder_root->n_children];
         }
+        ponder_table[child->move] = ' ';
+        if (root)
+            break;
+    }
+out:
+    mcts_ponder_reset();
+    return root;
+}
+
+/* The move to play: a proven win, else the most visited move not proven
+ * lost, else the most visited one.
+ */
+static struct node *best_child(const struct node *root)
+{
+    struct node *best = NULL;
+
+    for (int i = 0; i < root->n_children; i++) {
+        struct node *child = root->children[i];
+
+        if (child->proven == PROVEN_WIN)
+            return child;
+        if (!best || (best->proven == PROVEN_LOSS) >
+                         (child->proven == PROVEN_LOSS) ||
+            ((best->proven == PROVEN_LOSS) == (child->proven == PROVEN_LOSS) &&
+             child->n_visits > best->n_visits))
+            best = child;
     }
+    return best;
+}
+
+/* Whether more iterations cannot change the value of the move to play: the
+ * root is proven, or a single move is not proven lost. A visit lead alone
+ * decides nothing, since a rival may still be proven a win or the leader a
+ * loss.
+ */
+static bool decided(const struct node *root)
+{
+    int candidates = 0;
+
+    if (root->proven)
+        return true;
+    if (!root->children)
+        return false;
+    for (int i = 0; i < root->n_children && candidates < 2; i++)
+        if (root->children[i]->proven != PROVEN_LOSS)
+            candidates++;
+    return candidates <= 1;
+}
+
+int mcts(char *table, char player, int iterations, const bool *stop)
+{
+    struct node *root = ponder_take(table, player);
+    int i;
+
+    if (root) {
+        /* Visits made while pondering count against the budget */
+        mcts_stats.reused_visits += root->n_visits;
+        iterations -= root->n_visits;
+    } else {
+        root = new_node(-1, player, NULL);
+    }
+    for (i = 0; (i < iterations || !root->children) && !search_stopped(stop);
+         i++) {
+        /* Only iterate() proves moves */
+        if (decided(root))
+            break;
+        iterate(root, table);
+        if (!(i & 63))
+            cond_resched();
+    }
+    if (i < iterations && !search_stopped(stop)) {
+        mcts_stats.early_stops++;
+        mcts_stats.saved_iterations += iterations - i;
+    }
+
+    struct node *best_node = best_child(root);
 
     int best_move;
     if (best_node) {
@@ -235,5 +407,23 @@ int mcts(char *table, char player)
     free_node(root);
     return best_move;
 }
+static void mcts_counters(struct engine_counters *c)
+{
+    c->nodes = mcts_stats.iterations;
+    c->rollouts = mcts_stats.rollouts;
+    /* A node and its slot in the parent's children */
+    c->memory =
+        mcts_stats.live_nodes * (sizeof(struct node) + sizeof(struct node *));
+}
+
+const struct engine_ops mcts_engine = {
+    .name = "mcts",
+    .budget = ITERATIONS,
+    .exit = mcts_ponder_reset,
+    .search = mcts,
+    .ponder = mcts_ponder,
+    .reset = mcts_ponder_reset,
+    .counters = mcts_counters,
+};
 
-MODULE_LICENSE("GPL");
\ No newline at end of file
+MODULE_LICENSE("GPL");
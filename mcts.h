@@ -1,6 +1,26 @@
 #pragma once
 
+#include <linux/types.h>
+
 #define ITERATIONS 100000
 #define EXPLORATION_FACTOR 1U << (frac_bits - 1)
 
-int mcts(char *table, char player);
+struct mcts_stats {
+    unsigned long iterations;        /* selection/expansion/backprop passes */
+    unsigned long rollouts;          /* random playouts */
+    unsigned long nodes;             /* tree nodes allocated */
+    unsigned long live_nodes;        /* tree nodes not freed yet */
+    unsigned long ponder_iterations; /* iterations on the opponent's time */
+    unsigned long reused_visits;     /* pondered visits kept by mcts() */
+    unsigned long early_stops;       /* mcts() calls ended once decided */
+    unsigned long saved_iterations;  /* budget left by early stops */
+};
+
+extern struct mcts_stats mcts_stats;
+
+int mcts(char *table, char player, int iterations, const bool *stop);
+void mcts_ponder(const char *table,
+                 char player,
+                 int iterations,
+                 const bool *stop);
+void mcts_ponder_reset(void);
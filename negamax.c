@@ -1,84 +1,202 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
-#include <linux/sort.h>
 #include <linux/string.h>
 #include <linux/types.h>
 
+#include "engine.h"
+#include "eval.h"
 #include "game.h"
 #include "negamax.h"
-#include "util.h"
 #include "zobrist.h"
 
-#define MAX_SEARCH_DEPTH 6
+/* Searches deeper than this are cut down to it */
+#define MAX_PLY 32
 
-static int history_score_sum[N_GRIDS];
-static int history_count[N_GRIDS];
+/* Move ordering: the TT move first, then the killer moves of the ply, then
+ * the rest by butterfly history.
+ */
+#define TT_MOVE_SCORE INT_MAX
+#define KILLER_SCORE (1 << 30)
+#define HISTORY_MAX (1 << 28)
+
+/* Above any evaluation on a 16x16 board, and safe to negate */
+#define SCORE_INF (1 << 30)
+
+/* First half-width of an aspiration window, multiplied by
+ * ASPIRATION_GROWTH on each failure.
+ */
+#define ASPIRATION_DELTA 30
+#define ASPIRATION_GROWTH 4
+
+static struct {
+    u8 moves[N_GRIDS_MAX];
+    int scores[N_GRIDS_MAX];
+    int killers[2];
+} plies[MAX_PLY];
+
+/* History of beta cutoffs per side and cell, halved before every search so
+ * that it outlives a move but favours recent positions.
+ */
+static int history[2][N_GRIDS_MAX];
+static int history_size;
 
 static u64 hash_value;
+static struct eval_state eval;
+
+/* Cancellation token of the running search */
+static const bool *stop_flag;
+
+/* Reply to the predicted opponent move, computed by negamax_ponder() */
+static struct {
+    bool valid;
+    char player;
+    int max_depth;
+    enum negamax_driver driver;
+    struct game_geometry geometry;
+    char table[N_GRIDS_MAX];
+    move_t result;
+} ponder;
+
+struct negamax_stats negamax_stats;
+
+enum negamax_driver negamax_driver = NEGAMAX_PVS;
+EXPORT_SYMBOL(negamax_driver);
+
+const char *const negamax_driver_names[NR_NEGAMAX_DRIVERS] = {
+    [NEGAMAX_PVS] = "pvs",
+    [NEGAMAX_ASPIRATION] = "aspiration",
+    [NEGAMAX_MTDF] = "mtdf",
+};
+EXPORT_SYMBOL(negamax_driver_names);
+
+static void age_history(void)
+{
+    if (history_size != BOARD_SIZE) {
+        memset(history, 0, sizeof(history));
+        history_size = BOARD_SIZE;
+        return;
+    }
+    for (int side = 0; side < 2; side++)
+        for (int i = 0; i < N_GRIDS; i++)
+            history[side][i] >>= 1;
+}
+
+/* Fill plies[ply] with the empty cells of @table, best first */
+static int order_moves(const char *table, int ply, int side, int tt_move)
+{
+    u8 *moves = plies[ply].moves;
+    int *scores = plies[ply].scores;
+    const int *killers = plies[ply].killers;
+    int n_moves = 0;
+
+    for_each_empty_grid (i, table) {
+        int score, j;
+
+        if (i == tt_move)
+            score = TT_MOVE_SCORE;
+        else if (i == killers[0])
+            score = KILLER_SCORE + 1;
+        else if (i == killers[1])
+            score = KILLER_SCORE;
+        else
+            score = history[side][i];
+
+        /* Insertion sort: only a handful of cells move in practice */
+        for (j = n_moves++; j > 0 && scores[j - 1] < score; j--) {
+            moves[j] = moves[j - 1];
+            scores[j] = scores[j - 1];
+        }
+        moves[j] = i;
+        scores[j] = score;
+    }
+    return n_moves;
+}
 
-static int cmp_moves(const void *a, const void *b)
+static void update_cutoff(int ply, int side, int move, int depth)
 {
-    int *_a = (int *) a, *_b = (int *) b;
-    int score_a = 0, score_b = 0;
+    int *killers = plies[ply].killers;
 
-    if (history_count[*_a])
-        score_a = history_score_sum[*_a] / history_count[*_a];
-    if (history_count[*_b])
-        score_b = history_score_sum[*_b] / history_count[*_b];
-    return score_b - score_a;
+    if (killers[0] != move) {
+        killers[1] = killers[0];
+        killers[0] = move;
+    }
+    history[side][move] += depth * depth;
+    if (history[side][move] > HISTORY_MAX)
+        for (int i = 0; i < N_GRIDS; i++)
+            history[side][i] >>= 1;
 }
 
-static move_t negamax(char *table, int depth, char player, int alpha, int beta)
+static move_t negamax(char *table,
+                      int depth,
+                      int ply,
+                      char player,
+                      int alpha,
+                      int beta)
 {
+    int tt_move = -1, side = player == 'X';
+    int alpha_orig = alpha;
+
+    if (!(++negamax_stats.nodes & 1023))
+        cond_resched();
+    if (unlikely(search_stopped(stop_flag)))
+        return (move_t){0, -1};
     if (check_win(table) != ' ' || depth == 0) {
-        move_t result = {get_score(table, player), -1};
+        move_t result = {eval_score(&eval, player), -1};
         return result;
     }
     zobrist_entry_t *entry = zobrist_get(hash_value);
-    if (entry)
-        return (move_t){.score = entry->score, .move = entry->move};
+    if (entry) {
+        if (entry->depth >= depth &&
+            (entry->bound == TT_EXACT ||
+             (entry->bound == TT_LOWER && entry->score >= beta) ||
+             (entry->bound == TT_UPPER && entry->score <= alpha)))
+            return (move_t){.score = entry->score, .move = entry->move};
+        tt_move = entry->move;
+    }
 
     int score;
-    move_t best_move = {-10000, -1};
-    int *moves = available_moves(table);
-    int n_moves = 0;
-    while (n_moves < N_GRIDS && moves[n_moves] != -1)
-        ++n_moves;
-    sort(moves, n_moves, sizeof(int), cmp_moves, NULL);
+    move_t best_move = {-SCORE_INF, -1};
+    const u8 *moves = plies[ply].moves;
+    int n_moves = order_moves(table, ply, side, tt_move);
     for (int i = 0; i < n_moves; i++) {
         table[moves[i]] = player;
-        hash_value ^= zobrist_table[moves[i]][player == 'X'];
+        hash_value ^= zobrist_table[moves[i]][side];
+        eval_place(&eval, moves[i], player);
         if (!i)  // do a full search on the first move
-            score = -negamax(table, depth - 1, player == 'X' ? 'O' : 'X', -beta,
-                             -alpha)
+            score = -negamax(table, depth - 1, ply + 1,
+                             player == 'X' ? 'O' : 'X', -beta, -alpha)
                          .score;
         else {
             // do a null-window search on the rest of the moves
-            score = -negamax(table, depth - 1, player == 'X' ? 'O' : 'X',
-                             -alpha - 1, -alpha)
+            score = -negamax(table, depth - 1, ply + 1,
+                             player == 'X' ? 'O' : 'X', -alpha - 1, -alpha)
                          .score;
             if (alpha < score && score < beta)  // do a full re-search
-                score = -negamax(table, depth - 1, player == 'X' ? 'O' : 'X',
-                                 -beta, -score)
+                score = -negamax(table, depth - 1, ply + 1,
+                                 player == 'X' ? 'O' : 'X', -beta, -score)
                              .score;
         }
-        history_count[moves[i]]++;
-        history_score_sum[moves[i]] += score;
         if (score > best_move.score) {
             best_move.score = score;
             best_move.move = moves[i];
         }
         table[moves[i]] = ' ';
-        hash_value ^= zobrist_table[moves[i]][player == 'X'];
+        hash_value ^= zobrist_table[moves[i]][side];
+        eval_remove(&eval, moves[i], player);
         if (score > alpha)
             alpha = score;
-        if (alpha >= beta)
+        if (alpha >= beta) {
+            update_cutoff(ply, side, moves[i], depth);
             break;
+        }
     }
 
-    kfree((char *) moves);
-    zobrist_put(hash_value, best_move.score, best_move.move);
+    zobrist_put(hash_value, best_move.score, best_move.move, depth,
+                best_move.score <= alpha_orig ? TT_UPPER
+                : best_move.score >= beta     ? TT_LOWER
+                                              : TT_EXACT);
     return best_move;
 }
 
@@ -89,16 +207,205 @@ void negamax_init(void)
 }
 EXPORT_SYMBOL(negamax_init);
 
-move_t negamax_predict(char *table, char player)
+void negamax_exit(void)
+{
+    zobrist_exit();
+}
+EXPORT_SYMBOL(negamax_exit);
+
+static move_t root_search(char *table, char player, int depth, int alpha,
+                          int beta)
+{
+    negamax_stats.searches++;
+    return negamax(table, depth, 0, player, alpha, beta);
+}
+
+/* Search a window around @guess, widening the failing side until the score
+ * falls inside it.
+ */
+static move_t aspiration(char *table, char player, int depth, int guess)
+{
+    int delta = ASPIRATION_DELTA;
+    int alpha = max(guess - delta, -SCORE_INF);
+    int beta = min(guess + delta, SCORE_INF);
+
+    for (;;) {
+        move_t result = root_search(table, player, depth, alpha, beta);
+
+        if (search_stopped(stop_flag))
+            return result;
+        if (result.score <= alpha && alpha > -SCORE_INF)
+            alpha = max(result.score - delta, -SCORE_INF);
+        else if (result.score >= beta && beta < SCORE_INF)
+            beta = min(result.score + delta, SCORE_INF);
+        else
+            return result;
+        if (delta < SCORE_INF / ASPIRATION_GROWTH)
+            delta *= ASPIRATION_GROWTH;
+    }
+}
+
+/* MTD(f): zero-window searches move a lower and an upper bound towards each
+ * other, starting from @guess. The move comes from the last search that
+ * failed high, whose score is the final lower bound.
+ */
+static move_t mtdf(char *table, char player, int depth, int guess)
+{
+    int lower = -SCORE_INF, upper = SCORE_INF;
+    move_t best = {guess, -1};
+
+    while (lower < upper && !search_stopped(stop_flag)) {
+        int beta = max(best.score, lower + 1);
+        move_t result = root_search(table, player, depth, beta - 1, beta);
+
+        if (result.score < beta) {
+            upper = result.score;
+        } else {
+            lower = result.score;
+            if (result.move != -1)
+                best.move = result.move;
+        }
+        best.score = result.score;
+    }
+    return best;
+}
+
+static move_t search(char *table, char player, int max_depth)
+{
+    move_t result = {0, -1};
+
+    zobrist_begin();
+    age_history();
+    eval_init(&eval, table);
+    for (int ply = 0; ply < MAX_PLY; ply++)
+        plies[ply].killers[0] = plies[ply].killers[1] = -1;
+    max_depth = min(max_depth, MAX_PLY);
+
+    /* Deepen two plies at a time so each iteration ends on the same side.
+     * The TT is kept between iterations to order moves, entries from
+     * shallower iterations are not used for their score.
+     */
+    for (int depth = 2 - (max_depth & 1); depth <= max_depth; depth += 2) {
+        bool first = depth <= 2;
+        move_t prev = result;
+
+        if (negamax_driver == NEGAMAX_ASPIRATION && !first)
+            result = aspiration(table, player, depth, prev.score);
+        else if (negamax_driver == NEGAMAX_MTDF)
+            result = mtdf(table, player, depth, prev.score);
+        else
+            result = root_search(table, player, depth, -SCORE_INF, SCORE_INF);
+        /* Keep the last completed iteration of a cancelled search */
+        if (search_stopped(stop_flag)) {
+            result = prev;
+            break;
+        }
+        if (result.move == -1)
+            result.move = prev.move;
+    }
+    zobrist_end();
+    return result;
+}
+
+move_t negamax_predict(char *table,
+                       char player,
+                       int max_depth,
+                       const bool *stop)
 {
-    memset(history_score_sum, 0, sizeof(history_score_sum));
-    memset(history_count, 0, sizeof(history_count));
     move_t result;
-    for (int depth = 2; depth <= MAX_SEARCH_DEPTH; depth += 2) {
-        result = negamax(table, depth, player, -100000, 100000);
-        zobrist_clear();
+
+    if (ponder.valid && ponder.player == player &&
+        ponder.max_depth == max_depth && ponder.driver == negamax_driver &&
+        ponder.geometry.size == BOARD_SIZE &&
+        ponder.geometry.goal == GOAL &&
+        !memcmp(ponder.table, table, N_GRIDS)) {
+        ponder.valid = false;
+        negamax_stats.ponder_hits++;
+        return ponder.result;
     }
+    ponder.valid = false;
+    stop_flag = stop;
+    result = search(table, player, max_depth);
+    stop_flag = NULL;
     return result;
 }
 
-MODULE_LICENSE("GPL");
\ No newline at end of file
+/* Guess the reply of @player, to move on @table, and search our answer to it
+ * so that negamax_predict() returns at once if the guess was right.
+ */
+void negamax_ponder(const char *table,
+                    char player,
+                    int max_depth,
+                    const bool *stop)
+{
+    char t[N_GRIDS_MAX];
+    move_t reply, result;
+
+    ponder.valid = false;
+    memcpy(t, table, N_GRIDS);
+    stop_flag = stop;
+
+    reply = search(t, player, max_depth);
+    if (search_stopped(stop) || reply.move == -1)
+        goto out;
+    t[reply.move] = player;
+    if (check_win(t) != ' ')
+        goto out;
+    result = search(t, player ^ 'O' ^ 'X', max_depth);
+    if (search_stopped(stop))
+        goto out;
+
+    memcpy(ponder.table, t, N_GRIDS);
+    ponder.player = player ^ 'O' ^ 'X';
+    ponder.max_depth = max_depth;
+    ponder.driver = negamax_driver;
+    ponder.geometry = geometry;
+    ponder.result = result;
+    ponder.valid = true;
+out:
+    stop_flag = NULL;
+}
+
+static int negamax_engine_init(void)
+{
+    negamax_init();
+    return 0;
+}
+
+static int negamax_search(char *table,
+                          char player,
+                          int budget,
+                          const bool *stop)
+{
+    return negamax_predict(table, player, budget, stop).move;
+}
+
+static void negamax_reset(void)
+{
+    ponder.valid = false;
+}
+
+static void negamax_clear(void)
+{
+    memset(history, 0, sizeof(history));
+}
+
+static void negamax_counters(struct engine_counters *c)
+{
+    c->nodes = negamax_stats.nodes;
+    c->memory = zobrist_memory();
+}
+
+const struct engine_ops negamax_engine = {
+    .name = "negamax",
+    .budget = MAX_SEARCH_DEPTH,
+    .init = negamax_engine_init,
+    .exit = negamax_exit,
+    .search = negamax_search,
+    .ponder = negamax_ponder,
+    .clear = negamax_clear,
+    .reset = negamax_reset,
+    .counters = negamax_counters,
+};
+
+MODULE_LICENSE("GPL");
@@ -1,8 +1,38 @@
 #pragma once
 
+#include <linux/types.h>
+
+#define MAX_SEARCH_DEPTH 6
+
 typedef struct {
     int score, move;
 } move_t;
 
+/* How each iterative-deepening iteration searches the root */
+enum negamax_driver {
+    NEGAMAX_PVS,        /* one full-window search */
+    NEGAMAX_ASPIRATION, /* narrow window around the previous score */
+    NEGAMAX_MTDF,       /* zero-window searches converging on the score */
+    NR_NEGAMAX_DRIVERS,
+};
+
+struct negamax_stats {
+    unsigned long nodes;       /* calls to negamax(), leaves included */
+    unsigned long ponder_hits; /* moves answered by negamax_ponder() */
+    unsigned long searches;    /* root searches, re-searches included */
+};
+
+extern struct negamax_stats negamax_stats;
+extern enum negamax_driver negamax_driver;
+extern const char *const negamax_driver_names[NR_NEGAMAX_DRIVERS];
+
 void negamax_init(void);
-move_t negamax_predict(char *table, char player);
+void negamax_exit(void);
+move_t negamax_predict(char *table,
+                       char player,
+                       int max_depth,
+                       const bool *stop);
+void negamax_ponder(const char *table,
+                    char player,
+                    int max_depth,
+                    const bool *stop);
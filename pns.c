@@ -0,0 +1,341 @@
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "cache.h"
+#include "engine.h"
+#include "game.h"
+#include "pns.h"
+#include "zobrist.h"
+
+/* Depth-first proof-number search (df-pn) in negamax form. Every position
+ * carries a proof number phi, the cost of proving its question for the side
+ * to move, and a disproof number delta. The question is either "does the side
+ * to move win" (strict) or "does it avoid losing"; proving one for a position
+ * disproves the other for the opponent, so children ask the other question.
+ * A position is proven when phi is 0 and disproven when delta is 0.
+ */
+#define PNS_INF (1U << 30)
+
+#define BUCKET_SIZE 4
+
+/* Distinguishes the keys of the non-strict question */
+#define DRAW_SALT 0x9e3779b97f4a7c15ULL
+
+struct pns_entry {
+    u64 key;
+    u32 phi, delta; /* both 0 for an empty slot */
+    u32 work;       /* positions expanded below, for replacement */
+};
+
+/* Bounded proof table, kept across moves and games of the same geometry */
+static struct pns_entry *pns_table;
+static struct game_geometry pns_geometry;
+
+static u8 plies[PNS_MAX_PLY][N_GRIDS_MAX];
+
+static u64 hash_value;
+static unsigned long nodes_left;
+static const bool *stop_flag;
+
+struct pns_stats pns_stats;
+
+static inline u64 question_key(u64 hash, bool strict)
+{
+    return strict ? hash : hash ^ DRAW_SALT;
+}
+
+static struct pns_entry *lookup(u64 key)
+{
+    struct pns_entry *bucket = &pns_table[key & (PNS_TABLE_SIZE - BUCKET_SIZE)];
+
+    for (int i = 0; i < BUCKET_SIZE; i++)
+        if (bucket[i].key == key && (bucket[i].phi || bucket[i].delta))
+            return &bucket[i];
+    return NULL;
+}
+
+/* Overwrite the entry of @key, else an empty slot, else the cheapest one */
+static void store(u64 key, u32 phi, u32 delta, u32 work)
+{
+    struct pns_entry *bucket = &pns_table[key & (PNS_TABLE_SIZE - BUCKET_SIZE)];
+    struct pns_entry *victim = NULL;
+
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        struct pns_entry *e = &bucket[i];
+        if (e->key == key || (!e->phi && !e->delta)) {
+            victim = e;
+            break;
+        }
+        if (!victim || e->work < victim->work)
+            victim = e;
+    }
+    victim->key = key;
+    victim->phi = phi;
+    victim->delta = delta;
+    victim->work = work;
+}
+
+/* Proof and disproof numbers of the position after @player plays @move,
+ * where the opponent is asked the question opposite to @strict.
+ */
+static void child_numbers(char *table,
+                          int move,
+                          char player,
+                          bool strict,
+                          u32 *phi,
+                          u32 *delta)
+{
+    u64 key = question_key(hash_value ^ zobrist_table[move][player == 'X'],
+                           !strict);
+    struct pns_entry *e = lookup(key);
+    char win;
+
+    if (e) {
+        *phi = e->phi;
+        *delta = e->delta;
+        return;
+    }
+
+    table[move] = player;
+    win = check_win(table);
+    table[move] = ' ';
+    if (win == ' ') {
+        *phi = *delta = 1;
+        return;
+    }
+    /* The game is over and the opponent did not make the last move: its
+     * only answer is a draw to the non-strict question.
+     */
+    if (strict && win == 'D') {
+        *phi = 0;
+        *delta = PNS_INF;
+    } else {
+        *phi = PNS_INF;
+        *delta = 0;
+    }
+    store(key, *phi, *delta, 0);
+}
+
+static void mid(char *table,
+                char player,
+                bool strict,
+                int ply,
+                u32 th_phi,
+                u32 th_delta)
+{
+    u64 key = question_key(hash_value, strict);
+    struct pns_entry *e = lookup(key);
+    unsigned long start = nodes_left;
+    u8 *moves = plies[ply];
+    int n_moves = 0;
+    u32 phi, delta;
+
+    if (e && (e->phi >= th_phi || e->delta >= th_delta))
+        return;
+    if (!(pns_stats.nodes & 1023))
+        cond_resched();
+    /* Cancelling the search is running out of budget */
+    if (search_stopped(stop_flag))
+        nodes_left = 0;
+    if (!nodes_left)
+        return;
+    nodes_left--;
+    pns_stats.nodes++;
+
+    for_each_empty_grid (i, table)
+        moves[n_moves++] = i;
+
+    for (;;) {
+        u32 best_phi = 0, second = PNS_INF;
+        u64 sum = 0;
+        int best = -1;
+
+        phi = PNS_INF;
+        for (int i = 0; i < n_moves; i++) {
+            u32 c_phi, c_delta;
+
+            child_numbers(table, moves[i], player, strict, &c_phi, &c_delta);
+            sum += c_phi;
+            if (c_delta < phi) {
+                second = phi;
+                phi = c_delta;
+                best_phi = c_phi;
+                best = moves[i];
+            } else if (c_delta < second) {
+                second = c_delta;
+            }
+        }
+        delta = min_t(u64, sum, PNS_INF);
+        if (phi >= th_phi || delta >= th_delta || !nodes_left)
+            break;
+
+        table[best] = player;
+        hash_value ^= zobrist_table[best][player == 'X'];
+        mid(table, player ^ 'O' ^ 'X', !strict, ply + 1,
+            th_delta - (delta - best_phi), min(th_phi, second + 1));
+        table[best] = ' ';
+        hash_value ^= zobrist_table[best][player == 'X'];
+    }
+    store(key, phi, delta, start - nodes_left);
+}
+
+/* Answer @strict for @player to move on @table: 1 if proven, with the move
+ * that proves it in @move, 0 if disproven and -1 if out of budget.
+ */
+static int prove(char *table, char player, bool strict, int *move)
+{
+    for (int tries = 0; tries < 2; tries++) {
+        struct pns_entry *e;
+
+        mid(table, player, strict, 0, PNS_INF, PNS_INF);
+        e = lookup(question_key(hash_value, strict));
+        if (!e || (e->phi && e->delta))
+            return -1;
+        if (e->delta == 0)
+            return 0;
+
+        for_each_empty_grid (i, table) {
+            u32 c_phi, c_delta;
+
+            child_numbers(table, i, player, strict, &c_phi, &c_delta);
+            if (!c_delta) {
+                *move = i;
+                return 1;
+            }
+        }
+        /* The proving child was evicted: search the position again */
+        e->phi = e->delta = 1;
+    }
+    return -1;
+}
+
+struct pns_result pns_solve(char *table,
+                            char player,
+                            unsigned long budget,
+                            const bool *stop)
+{
+    struct pns_result result = {-1, PNS_UNKNOWN};
+    unsigned long start = pns_stats.nodes;
+    int n_empty = 0, ret;
+
+    for_each_empty_grid (i, table)
+        n_empty++;
+    if (!pns_table || n_empty > PNS_MAX_PLY || check_win(table) != ' ')
+        goto out;
+
+    if (pns_geometry.size != BOARD_SIZE || pns_geometry.goal != GOAL) {
+        memset(pns_table, 0, PNS_TABLE_SIZE * sizeof(*pns_table));
+        pns_geometry = geometry;
+    }
+    hash_value = 0;
+    for (int i = 0; i < N_GRIDS; i++)
+        if (table[i] != ' ')
+            hash_value ^= zobrist_table[i][table[i] == 'X'];
+    result.value = cache_probe(table, player, hash_value, &result.move);
+    if (result.value != PNS_UNKNOWN)
+        goto out;
+    nodes_left = budget;
+    stop_flag = stop;
+
+    ret = prove(table, player, true, &result.move);
+    if (ret == 1) {
+        result.value = PNS_WIN;
+    } else if (ret == 0) {
+        ret = prove(table, player, false, &result.move);
+        if (ret == 1) {
+            result.value = PNS_DRAW;
+        } else if (ret == 0) {
+            /* Every move loses, play the first one */
+            result.value = PNS_LOSS;
+            for_each_empty_grid (i, table) {
+                result.move = i;
+                break;
+            }
+        }
+    }
+    stop_flag = NULL;
+    if (result.value != PNS_UNKNOWN)
+        cache_store(player, hash_value, result.move, result.value);
+out:
+    if (result.value == PNS_UNKNOWN) {
+        pns_stats.unsolved++;
+    } else {
+        pns_stats.solved++;
+        if (pns_stats.nodes == start)
+            pns_stats.instant++;
+    }
+    return result;
+}
+
+/* Play the proven move, or the fallback's when the position is not solved.
+ * The fallback gets the share of its own budget that @budget is of
+ * PNS_NODES, so that scaled budgets scale both searches.
+ */
+int pns(char *table, char player, unsigned long budget, const bool *stop)
+{
+    const struct engine_ops *fallback = pns_engine.fallback;
+    struct pns_result result = pns_solve(table, player, budget, stop);
+    int fallback_budget;
+
+    if (result.value != PNS_UNKNOWN)
+        return result.move;
+    fallback_budget = clamp_t(u64, div_u64((u64) fallback->budget * budget,
+                                           PNS_NODES),
+                              1, fallback->budget);
+    return fallback->search(table, player, fallback_budget, stop);
+}
+
+int pns_init(void)
+{
+    pns_table = kvcalloc(PNS_TABLE_SIZE, sizeof(*pns_table), GFP_KERNEL);
+    if (!pns_table)
+        return -ENOMEM;
+    pns_geometry = geometry;
+    return 0;
+}
+
+void pns_exit(void)
+{
+    kvfree(pns_table);
+    pns_table = NULL;
+}
+
+static int pns_search(char *table, char player, int budget, const bool *stop)
+{
+    return pns(table, player, budget, stop);
+}
+
+static void pns_counters(struct engine_counters *c)
+{
+    c->nodes = pns_stats.nodes;
+    c->memory = sizeof(struct cache_entry) * CACHE_SIZE;
+    if (pns_table)
+        c->memory += sizeof(*pns_table) * PNS_TABLE_SIZE;
+}
+
+static void pns_clear(void)
+{
+    if (pns_table)
+        memset(pns_table, 0, PNS_TABLE_SIZE * sizeof(*pns_table));
+    cache_clear();
+}
+
+/* Proofs stay valid across games: nothing to reset, and nothing to gain by
+ * pondering since a solved position is answered from the tables.
+ */
+const struct engine_ops pns_engine = {
+    .name = "pns",
+    .budget = PNS_NODES,
+    .init = pns_init,
+    .exit = pns_exit,
+    .search = pns_search,
+    .clear = pns_clear,
+    .counters = pns_counters,
+    .fallback = &negamax_engine,
+};
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <linux/types.h>
+
+/* Default node budget of a pns() move */
+#define PNS_NODES 100000
+
+/* Entries of the proof table, a power of two */
+#define PNS_TABLE_SIZE (1 << 16)
+
+/* Positions with more empty cells than this are not searched */
+#define PNS_MAX_PLY 32
+
+/* Game-theoretic value of a position for the side to move */
+enum pns_value {
+    PNS_UNKNOWN, /* not solved within the budget */
+    PNS_WIN,
+    PNS_DRAW,
+    PNS_LOSS,
+};
+
+struct pns_result {
+    int move;
+    enum pns_value value;
+};
+
+struct pns_stats {
+    unsigned long nodes;    /* positions expanded */
+    unsigned long solved;   /* pns_solve() calls that found the value */
+    unsigned long unsolved; /* pns_solve() calls that ran out of budget */
+    unsigned long instant;  /* solved without expanding a position */
+};
+
+extern struct pns_stats pns_stats;
+
+int pns_init(void);
+void pns_exit(void);
+struct pns_result pns_solve(char *table,
+                            char player,
+                            unsigned long budget,
+                            const bool *stop);
+int pns(char *table, char player, unsigned long budget, const bool *stop);
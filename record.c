@@ -0,0 +1,244 @@
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include "game.h"
+#include "record.h"
+
+/* Capture of the moves played by the engines, with their time, for replaying
+ * them through the producer path at the original pacing or as fast as the
+ * reader drains them. The buffer is allocated by the first capture or import
+ * and kept until unload, so that a capture can be exported and replayed any
+ * number of times.
+ */
+static struct {
+    struct record_header hdr;
+    struct record_event events[RECORD_EVENTS];
+} *trace;
+
+/* Serializes the capture against debugfs readers and writers */
+static DEFINE_MUTEX(record_lock);
+
+static bool recording, replaying;
+static u64 start_ns;
+
+/* Set by a valid header, for the events written after it */
+static bool importing;
+
+struct record_stats record_stats;
+
+static size_t trace_size(const struct record_header *hdr)
+{
+    return sizeof(*hdr) +
+           le32_to_cpu(hdr->n_events) * sizeof(struct record_event);
+}
+
+static bool header_valid(const struct record_header *hdr)
+{
+    if (memcmp(hdr->magic, RECORD_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != RECORD_VERSION ||
+        game_check_geometry(hdr->board_size, hdr->goal) ||
+        (hdr->turn != 'X' && hdr->turn != 'O') ||
+        le32_to_cpu(hdr->n_events) > RECORD_EVENTS)
+        return false;
+    /* The starting position is copied to the board as is */
+    for (int i = 0; i < hdr->board_size * hdr->board_size; i++) {
+        char c = hdr->board[i];
+
+        if (c != ' ' && c != 'X' && c != 'O')
+            return false;
+    }
+    return true;
+}
+
+/* Called with record_lock held */
+static int trace_alloc(void)
+{
+    if (!trace)
+        trace = vzalloc(sizeof(*trace));
+    return trace ? 0 : -ENOMEM;
+}
+
+/* Start a new capture from @table with @turn to move, dropping the last one */
+int record_start(const char *table, char turn)
+{
+    int ret;
+
+    mutex_lock(&record_lock);
+    ret = replaying ? -EBUSY : trace_alloc();
+    if (!ret) {
+        memset(&trace->hdr, 0, sizeof(trace->hdr));
+        memcpy(trace->hdr.magic, RECORD_MAGIC, sizeof(trace->hdr.magic));
+        trace->hdr.version = RECORD_VERSION;
+        trace->hdr.board_size = BOARD_SIZE;
+        trace->hdr.goal = GOAL;
+        trace->hdr.turn = turn;
+        memcpy(trace->hdr.board, table, N_GRIDS);
+        importing = false;
+        start_ns = ktime_get_ns();
+        WRITE_ONCE(recording, true);
+    }
+    mutex_unlock(&record_lock);
+    return ret;
+}
+
+void record_add(int move, char player)
+{
+    u64 now = ktime_get_ns();
+    u32 n;
+
+    if (!READ_ONCE(recording))
+        return;
+    mutex_lock(&record_lock);
+    n = le32_to_cpu(trace->hdr.n_events);
+    if (!recording) {
+        /* Stopped meanwhile */
+    } else if (n < RECORD_EVENTS) {
+        struct record_event *ev = &trace->events[n];
+
+        ev->ns = cpu_to_le64(now - start_ns);
+        ev->move = cpu_to_le16(move);
+        ev->player = player;
+        memset(ev->reserved, 0, sizeof(ev->reserved));
+        trace->hdr.n_events = cpu_to_le32(n + 1);
+        record_stats.events++;
+    } else {
+        record_stats.overflows++;
+    }
+    mutex_unlock(&record_lock);
+}
+
+void record_stop(void)
+{
+    mutex_lock(&record_lock);
+    WRITE_ONCE(recording, false);
+    mutex_unlock(&record_lock);
+}
+
+/* Hold the trace for replaying: copy its header to @hdr and return the number
+ * of events, or a negative errno if there is nothing to replay.
+ */
+int record_replay_begin(struct record_header *hdr)
+{
+    int ret;
+
+    mutex_lock(&record_lock);
+    if (recording) {
+        ret = -EBUSY;
+    } else if (!trace || !header_valid(&trace->hdr)) {
+        ret = -ENOENT;
+    } else {
+        *hdr = trace->hdr;
+        ret = le32_to_cpu(hdr->n_events);
+        replaying = true;
+    }
+    mutex_unlock(&record_lock);
+    return ret;
+}
+
+/* Between record_replay_begin() and record_replay_end(), the trace is not
+ * written.
+ */
+void record_replay_event(u32 i, struct record_event *ev)
+{
+    *ev = trace->events[i];
+}
+
+void record_replay_end(void)
+{
+    mutex_lock(&record_lock);
+    replaying = false;
+    mutex_unlock(&record_lock);
+}
+
+void record_exit(void)
+{
+    vfree(trace);
+    trace = NULL;
+}
+
+/* /sys/kernel/debug/simrupt/record: read to save the last capture, write a
+ * saved one back to replay it.
+ */
+static ssize_t record_read(struct file *file,
+                           char __user *ubuf,
+                           size_t count,
+                           loff_t *ppos)
+{
+    ssize_t ret = 0;
+
+    mutex_lock(&record_lock);
+    if (trace && header_valid(&trace->hdr))
+        ret = simple_read_from_buffer(ubuf, count, ppos, trace,
+                                      trace_size(&trace->hdr));
+    mutex_unlock(&record_lock);
+    return ret;
+}
+
+static ssize_t record_write(struct file *file,
+                            const char __user *ubuf,
+                            size_t count,
+                            loff_t *ppos)
+{
+    struct record_header hdr;
+    loff_t off = *ppos;
+    ssize_t ret = count;
+
+    mutex_lock(&record_lock);
+    if (recording || replaying) {
+        ret = -EBUSY;
+        goto out;
+    }
+    if (trace_alloc()) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    if (off == 0) {
+        if (count < sizeof(hdr)) {
+            ret = -EINVAL;
+            goto out;
+        }
+        if (copy_from_user(&hdr, ubuf, sizeof(hdr))) {
+            ret = -EFAULT;
+            goto out;
+        }
+        if (!header_valid(&hdr)) {
+            ret = -EINVAL;
+            goto out;
+        }
+        trace->hdr = hdr;
+        importing = true;
+        ubuf += sizeof(hdr);
+        off = sizeof(hdr);
+        count -= sizeof(hdr);
+    } else if (!importing || off < sizeof(hdr)) {
+        ret = -EINVAL;
+        goto out;
+    }
+    if (off + count > trace_size(&trace->hdr)) {
+        ret = -EFBIG;
+        goto out;
+    }
+    if (copy_from_user((char *) trace + off, ubuf, count)) {
+        ret = -EFAULT;
+        goto out;
+    }
+    *ppos += ret;
+out:
+    mutex_unlock(&record_lock);
+    return ret;
+}
+
+const struct file_operations record_fops = {
+    .owner = THIS_MODULE,
+    .read = record_read,
+    .write = record_write,
+    .llseek = default_llseek,
+};
+
+MODULE_LICENSE("GPL");
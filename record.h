@@ -0,0 +1,48 @@
+#pragma once
+
+#include <linux/types.h>
+
+#include "simrupt_ioctl.h"
+
+/* Layout of a captured move stream as exported and imported through debugfs:
+ * the header followed by n_events events. All multi-byte fields are
+ * little-endian.
+ */
+#define RECORD_MAGIC "SRRT"
+#define RECORD_VERSION 1
+#define RECORD_EVENTS (1 << 16) /* capacity of the capture */
+
+struct record_header {
+    char magic[4];
+    __u8 version;
+    __u8 board_size;
+    __u8 goal;
+    char turn; /* side to move when the capture started */
+    __le32 n_events;
+    __le32 reserved;
+    char board[SIMRUPT_BOARD_MAX]; /* cells when the capture started */
+};
+
+struct record_event {
+    __le64 ns;   /* since the capture started */
+    __le16 move; /* cell played, 0xffff if the player had no move */
+    char player;
+    __u8 reserved[5];
+};
+
+struct record_stats {
+    unsigned long events;    /* captured */
+    unsigned long overflows; /* not captured, the buffer was full */
+};
+
+extern struct record_stats record_stats;
+
+int record_start(const char *table, char turn);
+void record_add(int move, char player);
+void record_stop(void);
+int record_replay_begin(struct record_header *hdr);
+void record_replay_event(u32 i, struct record_event *ev);
+void record_replay_end(void);
+void record_exit(void);
+
+extern const struct file_operations record_fops;
@@ -2,18 +2,36 @@
 
 #include <linux/cdev.h>
 #include <linux/circ_buf.h>
+#include <linux/device.h>
+#include <linux/hrtimer.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
 #include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/random.h>
+#include <linux/seqlock.h>
 #include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
 #include <linux/version.h>
 #include <linux/workqueue.h>
 
+#include "book.h"
+#include "engine.h"
 #include "game.h"
-#include "mcts.h"
 #include "negamax.h"
+#include "record.h"
+#include "simrupt_ioctl.h"
+#include "stats.h"
+#include "tournament.h"
+#include "xoroshiro128.h"
+#include "zobrist.h"
+
+#define CREATE_TRACE_POINTS
+#include "simrupt_trace.h"
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("National Cheng Kung University, Taiwan");
@@ -32,8 +50,227 @@ MODULE_DESCRIPTION("A device that simulates interrupts");
 
 static int delay = 100; /* time (in ms) to generate an event */
 
+/* Opening book / endgame tablebase requested from the firmware loader */
+static char *book = BOOK_FIRMWARE;
+module_param(book, charp, 0444);
+MODULE_PARM_DESC(book, "firmware file holding the precomputed book");
+
+/* Board geometry, changed between games through SIMRUPT_IOC_SET_GEOMETRY */
+static int board_size = DEFAULT_BOARD_SIZE;
+module_param(board_size, int, 0444);
+MODULE_PARM_DESC(board_size, "number of rows and columns of the board");
+static int goal = DEFAULT_GOAL;
+module_param(goal, int, 0444);
+MODULE_PARM_DESC(goal, "number of stones in a row needed to win");
+
+/* Root driver of negamax's iterative deepening, see enum negamax_driver */
+static int negamax_driver_set(const char *val, const struct kernel_param *kp)
+{
+    int driver = sysfs_match_string(negamax_driver_names, val);
+
+    if (driver < 0)
+        return driver;
+    WRITE_ONCE(negamax_driver, driver);
+    return 0;
+}
+
+static int negamax_driver_get(char *buf, const struct kernel_param *kp)
+{
+    return sysfs_emit(buf, "%s\n",
+                      negamax_driver_names[READ_ONCE(negamax_driver)]);
+}
+
+static const struct kernel_param_ops negamax_driver_ops = {
+    .set = negamax_driver_set,
+    .get = negamax_driver_get,
+};
+module_param_cb(negamax_driver, &negamax_driver_ops, NULL, 0644);
+MODULE_PARM_DESC(negamax_driver, "negamax root search: pvs, aspiration, mtdf");
+
+/* Transposition table size, applied between negamax searches */
+static int tt_kb_set(const char *val, const struct kernel_param *kp)
+{
+    unsigned int kb;
+    int ret = kstrtouint(val, 0, &kb);
+
+    if (ret)
+        return ret;
+    if (kb > TT_MAX_KB)
+        return -EINVAL;
+    return zobrist_resize((size_t) kb << 10);
+}
+
+static int tt_kb_get(char *buf, const struct kernel_param *kp)
+{
+    return sysfs_emit(buf, "%zu\n", zobrist_size() >> 10);
+}
+
+static const struct kernel_param_ops tt_kb_ops = {
+    .set = tt_kb_set,
+    .get = tt_kb_get,
+};
+module_param_cb(tt_kb, &tt_kb_ops, NULL, 0644);
+MODULE_PARM_DESC(tt_kb, "negamax transposition table size in KiB, 0 for none");
+
+/* Engine playing each side, chosen between moves */
+static int engine_x = ENGINE_MCTS, engine_o = ENGINE_NEGAMAX;
+
+static int engine_set(const char *val, const struct kernel_param *kp)
+{
+    int engine = engine_find(val);
+
+    if (engine < 0)
+        return engine;
+    WRITE_ONCE(*(int *) kp->arg, engine);
+    return 0;
+}
+
+static int engine_get(char *buf, const struct kernel_param *kp)
+{
+    return sysfs_emit(buf, "%s\n", engines[READ_ONCE(*(int *) kp->arg)]->name);
+}
+
+static const struct kernel_param_ops engine_ops = {
+    .set = engine_set,
+    .get = engine_get,
+};
+module_param_cb(engine_x, &engine_ops, &engine_x, 0644);
+MODULE_PARM_DESC(engine_x, "engine playing X: mcts, negamax, pns");
+module_param_cb(engine_o, &engine_ops, &engine_o, 0644);
+MODULE_PARM_DESC(engine_o, "engine playing O: mcts, negamax, pns");
+
+/* What to do when turns take longer than the tick, see adapt_turn() */
+enum { ADAPT_OFF, ADAPT_TICK, ADAPT_BUDGET, NR_ADAPT };
+
+static const char *const adaptive_names[NR_ADAPT] = {
+    [ADAPT_OFF] = "off",
+    [ADAPT_TICK] = "tick",
+    [ADAPT_BUDGET] = "budget",
+};
+
+static int adaptive = ADAPT_OFF;
+
+static int adaptive_set(const char *val, const struct kernel_param *kp)
+{
+    int mode = sysfs_match_string(adaptive_names, val);
+
+    if (mode < 0)
+        return mode;
+    WRITE_ONCE(adaptive, mode);
+    return 0;
+}
+
+static int adaptive_get(char *buf, const struct kernel_param *kp)
+{
+    return sysfs_emit(buf, "%s\n", adaptive_names[READ_ONCE(adaptive)]);
+}
+
+static const struct kernel_param_ops adaptive_ops = {
+    .set = adaptive_set,
+    .get = adaptive_get,
+};
+module_param_cb(adaptive, &adaptive_ops, NULL, 0644);
+MODULE_PARM_DESC(adaptive,
+                 "on overruns: off, tick (stretch the period), "
+                 "budget (shrink the searches)");
+
+/* Load generator: instead of playing, every interrupt produces a burst of
+ * storm_burst one-byte events that take the fast_buf -> tasklet -> workqueue
+ * -> kfifo -> read() path without running any engine. The interrupt is the
+ * tick timer, or an hrtimer every storm_period_us. Both apply from the next
+ * first open of the device.
+ */
+static unsigned int storm_burst;
+module_param(storm_burst, uint, 0644);
+MODULE_PARM_DESC(storm_burst, "events per interrupt, 0 plays the game");
+static unsigned int storm_period_us;
+
+/* Shorter periods would re-arm the hard-irq hrtimer back to back and could
+ * livelock the CPU.
+ */
+#define STORM_PERIOD_MIN_US 20
+
+static int storm_period_set(const char *val, const struct kernel_param *kp)
+{
+    unsigned int us;
+    int ret = kstrtouint(val, 0, &us);
+
+    if (ret)
+        return ret;
+    if (us && us < STORM_PERIOD_MIN_US)
+        return -EINVAL;
+    WRITE_ONCE(storm_period_us, us);
+    return 0;
+}
+
+static const struct kernel_param_ops storm_period_ops = {
+    .set = storm_period_set,
+    .get = param_get_uint,
+};
+module_param_cb(storm_period_us, &storm_period_ops, &storm_period_us, 0644);
+MODULE_PARM_DESC(storm_period_us,
+                 "interrupt period of the load generator in us, at least "
+                 "20, 0 for the tick");
+
+/* Settings of the running session, storm is 0 while playing */
+static unsigned int storm, storm_period;
+
+/* Capture and replay of the game: with record set, the moves of the next
+ * session are captured with their time, see record.c. With replay set, the
+ * next session plays the capture back through produce_data() instead of
+ * running the engines, at the original pacing or as fast as the reader
+ * drains the kfifo, and read() returns end of file once it is over.
+ */
+static bool record;
+module_param(record, bool, 0644);
+MODULE_PARM_DESC(record, "capture the moves of the next session");
+
+enum { REPLAY_OFF, REPLAY_PACED, REPLAY_FAST, NR_REPLAY };
+
+static const char *const replay_names[NR_REPLAY] = {
+    [REPLAY_OFF] = "off",
+    [REPLAY_PACED] = "paced",
+    [REPLAY_FAST] = "fast",
+};
+
+static int replay = REPLAY_OFF;
+
+static int replay_set(const char *val, const struct kernel_param *kp)
+{
+    int mode = sysfs_match_string(replay_names, val);
+
+    if (mode < 0)
+        return mode;
+    WRITE_ONCE(replay, mode);
+    return 0;
+}
+
+static int replay_get(char *buf, const struct kernel_param *kp)
+{
+    return sysfs_emit(buf, "%s\n", replay_names[READ_ONCE(replay)]);
+}
+
+static const struct kernel_param_ops replay_ops = {
+    .set = replay_set,
+    .get = replay_get,
+};
+module_param_cb(replay, &replay_ops, NULL, 0644);
+MODULE_PARM_DESC(replay,
+                 "replay the capture in the next session: off, paced, fast");
+
+/* Mode of the running session, REPLAY_OFF while playing */
+static int replay_mode;
+static bool replay_cancel, replay_done;
+
 /* Data produced by the simulated device */
-// static int simrupt_data = -1;
+static int simrupt_data = -1;
+
+/* Generate new data from the simulated device */
+static inline int update_simrupt_data(void)
+{
+    simrupt_data = max((simrupt_data + 1) % 0x7f, 0x20);
+    return simrupt_data;
+}
 
 /* Timer to simulate a periodic IRQ */
 static struct timer_list timer;
@@ -42,12 +279,14 @@ static struct timer_list timer;
 static int major;
 static struct class *simrupt_class;
 static struct cdev simrupt_cdev;
+static struct device *simrupt_device;
 
 /*draw game board*/
 #define ROWS (BOARD_SIZE * 2)
 #define COLS (BOARD_SIZE * 2 + 2)
-static char chess[ROWS * COLS + 1];
-static char table[N_GRIDS];  // record 'O' and 'X'
+#define CHESS_LEN (ROWS * COLS + 1)
+static char chess[BOARD_SIZE_MAX * 2 * (BOARD_SIZE_MAX * 2 + 2) + 1];
+static char table[N_GRIDS_MAX];  // record 'O' and 'X'
 static char turn;
 
 /*initialize chessboard*/
@@ -76,9 +315,18 @@ static void update_board(int val, const char *table)
 {
     int row = val / BOARD_SIZE;
     int col = val % BOARD_SIZE;
-    int index = 20 * row + (2 * (col + 1) - 1);
+    int index = 2 * row * COLS + 2 * col + 1;
     chess[index] = turn;
-    smp_wmb();
+}
+
+/* Redraw the chessboard from table, for a position not reached move by move */
+static void draw_board(void)
+{
+    init_board();
+    for (int i = 0; i < N_GRIDS; i++) {
+        int row = i / BOARD_SIZE, col = i % BOARD_SIZE;
+        chess[2 * row * COLS + 2 * col + 1] = table[i];
+    }
 }
 
 /* Data are stored into a kfifo buffer before passing them to the userspace */
@@ -93,6 +341,130 @@ static DEFINE_MUTEX(read_lock);
 /* Wait queue to implement blocking I/O from userspace */
 static DECLARE_WAIT_QUEUE_HEAD(rx_wait);
 
+/* Woken by read() and to cancel the replay, which waits there for the kfifo
+ * or for the time of the next move.
+ */
+static DECLARE_WAIT_QUEUE_HEAD(replay_wait);
+
+
+/* Snapshot of the game for SIMRUPT_IOC_GET_STATE and the state attribute.
+ * Monitors read it under the seqlock without touching rx_fifo or read_lock,
+ * so polling never steals frames from, or waits for, the consumer.
+ */
+_Static_assert(SIMRUPT_BOARD_MAX >= N_GRIDS_MAX,
+               "struct simrupt_state must hold the largest board");
+static DEFINE_SEQLOCK(state_lock);
+static struct simrupt_state game_state;
+
+/* Called from produce_data() once table and turn reflect the move */
+static void publish_state(int move, char win)
+{
+    write_seqlock(&state_lock);
+    if (win != ' ') {
+        game_state.games++;
+        game_state.winner = win;
+        game_state.moves = 0;
+        game_state.last_move = -1;
+    } else {
+        game_state.moves++;
+        game_state.last_move = move;
+    }
+    game_state.board_size = BOARD_SIZE;
+    game_state.goal = GOAL;
+    game_state.turn = turn;
+    memcpy(game_state.board, table, N_GRIDS);
+    memset(game_state.board + N_GRIDS, 0, SIMRUPT_BOARD_MAX - N_GRIDS);
+    write_sequnlock(&state_lock);
+}
+
+static void read_state(struct simrupt_state *st)
+{
+    unsigned int seq;
+
+    do {
+        seq = read_seqbegin(&state_lock);
+        *st = game_state;
+    } while (read_seqretry(&state_lock, seq));
+}
+
+/* Mutex to serialize kfifo writers within the workqueue handler */
+static DEFINE_MUTEX(producer_lock);
+
+/* Producer-side batching: frames are staged and reach the kfifo in one copy
+ * with one wakeup per batch, at most batch_ms after the first frame of the
+ * batch was staged. 0 copies every frame at once.
+ */
+static unsigned int batch_ms;
+module_param(batch_ms, uint, 0644);
+MODULE_PARM_DESC(batch_ms, "longest wait of a frame for its batch in ms");
+
+/* Staged frames, under producer_lock */
+static struct {
+    unsigned int len;
+    char buf[PAGE_SIZE]; /* the size of rx_fifo */
+} batch;
+
+/* Copy @len bytes to the kfifo, skipping what does not fit, and wake the
+ * readers up. Called with producer_lock held.
+ */
+static void fifo_put(const char *buf, unsigned int len)
+{
+    unsigned int in = kfifo_in(&rx_fifo, buf, len);
+    unsigned int used = kfifo_len(&rx_fifo);
+
+    if (unlikely(in < len)) {
+        atomic_long_add(len - in, &stats.dropped_bytes);
+        if (printk_ratelimit())
+            pr_warn("%s: %u bytes dropped\n", __func__, len - in);
+    }
+    if (used > stats.fifo_high)
+        stats.fifo_high = used;
+    atomic_long_inc(&stats.fifo_batches);
+    trace_simrupt_fifo_enqueue(in, used);
+    wake_up_interruptible(&rx_wait);
+}
+
+/* Called with producer_lock held */
+static void batch_flush(void)
+{
+    if (batch.len) {
+        fifo_put(batch.buf, batch.len);
+        batch.len = 0;
+    }
+}
+
+static void batch_work_func(struct work_struct *w)
+{
+    mutex_lock(&producer_lock);
+    batch_flush();
+    mutex_unlock(&producer_lock);
+}
+
+static DECLARE_DELAYED_WORK(batch_work, batch_work_func);
+
+/* Hand @len bytes to the kfifo, now or within batch_ms. Called with
+ * producer_lock held.
+ */
+static void produce(const char *buf, unsigned int len)
+{
+    unsigned int batch_delay = READ_ONCE(batch_ms);
+
+    if (!batch_delay) {
+        batch_flush();
+        fifo_put(buf, len);
+        return;
+    }
+    if (batch.len + len > sizeof(batch.buf))
+        batch_flush();
+    if (len > sizeof(batch.buf)) {
+        fifo_put(buf, len);
+        return;
+    }
+    memcpy(batch.buf + batch.len, buf, len);
+    batch.len += len;
+    /* Pending from an earlier frame of the batch, it already fires sooner */
+    schedule_delayed_work(&batch_work, msecs_to_jiffies(batch_delay));
+}
 
 /* Insert a value into the kfifo buffer */
 static void produce_data(unsigned char val)
@@ -101,32 +473,28 @@ static void produce_data(unsigned char val)
      * buffer is full).
      */
     char win = check_win(table);
-    unsigned int len;
     if (win != ' ') {
         update_board(val, chess);
-        pr_info("simrupt: %c win !!!\n", turn);
+        pr_info_ratelimited("simrupt: %c win !!!\n", turn);
         turn = 'X';
-        len = kfifo_in(&rx_fifo, chess, sizeof(chess));
+        produce(chess, CHESS_LEN);
+        /* A geometry change requested during the game applies from now on.
+         * A capture holds the moves of a single geometry, so it ends here.
+         */
+        if (board_size != BOARD_SIZE || goal != GOAL) {
+            record_stop();
+            game_configure(board_size, goal);
+        }
         init_board();
-        smp_wmb();
         memset(table, ' ', N_GRIDS);
-        smp_wmb();
     } else {
         update_board(val, chess);
         turn = turn == 'X' ? 'O' : 'X';
-        len = kfifo_in(&rx_fifo, chess, sizeof(chess));
+        produce(chess, CHESS_LEN);
     }
-
-    if (unlikely(len < sizeof(val)) && printk_ratelimit())
-        pr_warn("%s: %zu bytes dropped\n", __func__, sizeof(val) - len);
-
-    pr_debug("simrupt: %s: in %u/%u bytes\n", __func__, len,
-             kfifo_len(&rx_fifo));
+    publish_state(val, win);
 }
 
-/* Mutex to serialize kfifo writers within the workqueue handler */
-static DEFINE_MUTEX(producer_lock);
-
 /* Mutex to serialize fast_buf consumers: we can use a mutex because consumers
  * run in workqueue handler (kernel thread context).
  */
@@ -144,38 +512,154 @@ static void fast_buf_clear(void)
     fast_buf.head = fast_buf.tail = 0;
 }
 
-static void ai_func1(struct work_struct *w)
+/* Store a byte from interrupt context, the only producer */
+static int fast_buf_put(unsigned char val)
 {
-    int move;
+    struct circ_buf *ring = &fast_buf;
+    int head = ring->head, tail = smp_load_acquire(&ring->tail);
 
-    /* This code runs from a kernel thread, so softirqs and hard-irqs must
-     * be enabled.
-     */
-    WARN_ON_ONCE(in_softirq());
-    WARN_ON_ONCE(in_interrupt());
+    /* prevent buffer overflow */
+    if (CIRC_SPACE(head, tail, PAGE_SIZE) < 1)
+        return -ENOMEM;
 
-    /* Pretend to simulate access to per-CPU data, disabling preemption
-     * during the pr_info().
-     */
+    ring->buf[head] = val;
 
-    pr_info("simrupt: [CPU#%d] is turn %s to play chess\n", smp_processor_id(),
-            __func__);
+    /* Commit the item before incrementing the head */
+    smp_store_release(&ring->head, (head + 1) & (PAGE_SIZE - 1));
 
-    move = mcts(table, turn);
-    smp_wmb();
-    if (move != -1)
-        table[move] = turn;
+    return 0;
+}
 
-    /* Store data to the kfifo buffer */
-    mutex_lock(&producer_lock);
-    produce_data(move);
-    mutex_unlock(&producer_lock);
+/* Workqueue for asynchronous bottom-half processing */
+static struct workqueue_struct *simrupt_workqueue;
 
-    wake_up_interruptible(&rx_wait);
+/* Pondering: once it has moved, an engine with a ponder operation keeps
+ * searching on the opponent's time from simrupt_workqueue. The search is
+ * stopped when the engine's next turn starts, and its search reuses whatever
+ * matches the move the opponent actually played.
+ */
+static bool ponder = true;
+module_param(ponder, bool, 0644);
+MODULE_PARM_DESC(ponder, "search on the opponent's time");
+
+struct ponder_slot {
+    struct work_struct work;
+    bool stop;
+    char player; /* opponent, to move on table */
+    char table[N_GRIDS_MAX];
+};
+
+static struct ponder_slot ponder_slots[NR_ENGINES]; /* indexed by engine */
+
+static void ponder_func(struct work_struct *w)
+{
+    struct ponder_slot *slot = container_of(w, struct ponder_slot, work);
+    const struct engine_ops *ops = engines[slot - ponder_slots];
+
+    ops->ponder(slot->table, slot->player, ops->budget, &slot->stop);
 }
 
-static void ai_func2(struct work_struct *w)
+/* Called with producer_lock held, right after the engine's move */
+static void ponder_start(int engine)
 {
+    struct ponder_slot *slot = &ponder_slots[engine];
+
+    if (!READ_ONCE(ponder) || !engines[engine]->ponder)
+        return;
+    memcpy(slot->table, table, N_GRIDS);
+    slot->player = turn;
+    WRITE_ONCE(slot->stop, false);
+    queue_work(simrupt_workqueue, &slot->work);
+}
+
+static void ponder_stop(int engine)
+{
+    struct ponder_slot *slot = &ponder_slots[engine];
+
+    WRITE_ONCE(slot->stop, true);
+    cancel_work_sync(&slot->work);
+}
+
+/* Cancellation token of the searches run by ai_play(), set when the last
+ * reader closes the device and on unload.
+ */
+static bool search_cancel;
+
+/* Turn state machine. A tick only queues a turn once the previous one has
+ * been published: ticks arriving during a long search are counted as
+ * coalesced instead of being lost in schedule_work_on(), and the tasklet
+ * never reads turn while a worker flips it.
+ */
+enum { TURN_IDLE, TURN_QUEUED, TURN_SEARCHING };
+static atomic_t turn_state = ATOMIC_INIT(TURN_IDLE);
+
+/* Timestamps of the last timer tick, of the tick that queued the running
+ * turn and of the tasklet run, for the latency histograms.
+ */
+static u64 tick_ns, turn_tick_ns, tasklet_ns;
+
+/* Moving average of the tick-to-publish time, weight 1/8 */
+static u64 turn_avg_ns;
+
+static int scaled_budget(int engine, int full)
+{
+    if (READ_ONCE(adaptive) != ADAPT_BUDGET)
+        return full;
+    return max(1, full * (int) READ_ONCE(stats.budget_permille[engine]) / 1000);
+}
+
+/* Count overruns of the tick period and adapt the pacing to the last turn:
+ * stretch the period to the average turn plus a quarter, or scale the
+ * engine's budget so that its search takes half to three quarters of it.
+ */
+static void adapt_turn(int engine, u64 search_ns, u64 turn_ns)
+{
+    u64 period_ns = (u64) READ_ONCE(stats.tick_ms) * NSEC_PER_MSEC;
+    unsigned int permille = stats.budget_permille[engine];
+    unsigned int tick_ms = delay;
+
+    if (turn_ns > period_ns)
+        atomic_long_inc(&stats.overruns);
+    turn_avg_ns = turn_avg_ns - (turn_avg_ns >> 3) + (turn_ns >> 3);
+
+    switch (READ_ONCE(adaptive)) {
+    case ADAPT_TICK:
+        tick_ms = max_t(u64, delay,
+                        DIV_ROUND_UP_ULL(turn_avg_ns + (turn_avg_ns >> 2),
+                                         NSEC_PER_MSEC));
+        break;
+    case ADAPT_BUDGET:
+        if (!search_ns) /* book move */
+            break;
+        if (search_ns > period_ns - (period_ns >> 2))
+            permille = max(permille - (permille >> 2), 1U);
+        else if (search_ns < (period_ns >> 1))
+            permille = min(permille + (permille >> 2) + 1, 1000U);
+        WRITE_ONCE(stats.budget_permille[engine], permille);
+        break;
+    }
+    WRITE_ONCE(stats.tick_ms, tick_ms);
+}
+
+/* Whether @player playing @move on table ends the game. produce_data() may
+ * then switch the geometry, which no search may see while it runs.
+ */
+static bool ends_game(int move, char player)
+{
+    char next[N_GRIDS_MAX];
+
+    memcpy(next, table, N_GRIDS);
+    if (move != -1)
+        next[move] = player;
+    return check_win(next) != ' ';
+}
+
+/* Play one move for the side to move with @engine and publish the board */
+static void ai_play(int engine)
+{
+    char player = turn;
+    u64 start = ktime_get_ns(), work_ns = start - READ_ONCE(tasklet_ns);
+    u64 search_ns = 0, turn_ns;
     int move;
 
     /* This code runs from a kernel thread, so softirqs and hard-irqs must
@@ -184,28 +668,76 @@ static void ai_func2(struct work_struct *w)
     WARN_ON_ONCE(in_softirq());
     WARN_ON_ONCE(in_interrupt());
 
-    /* Pretend to simulate access to per-CPU data, disabling preemption
-     * during the pr_info().
-     */
+    atomic_set(&turn_state, TURN_SEARCHING);
+    stats_hist_add(HIST_WORK, work_ns);
+    trace_simrupt_work_start(player, work_ns);
 
-    pr_info("simrupt: [CPU#%d] is turn %s to play chess\n", smp_processor_id(),
-            __func__);
+    /* The engine state is not shared: take it back from the ponder search,
+     * and that of the engine it falls back to.
+     */
+    ponder_stop(engine);
+    if (engine_fallback(engine) >= 0)
+        ponder_stop(engine_fallback(engine));
 
-    move = negamax_predict(table, turn).move;
-    smp_wmb();
-    if (move != -1)
-        table[move] = turn;
+    move = book_probe(table, player);
+    if (move != -1) {
+        atomic_long_inc(&stats.book_hits);
+    } else {
+        struct engine_counters before, after;
+
+        trace_simrupt_search_start(player, engine);
+        engine_counters(engine, &before);
+        move = engine_search(engine, table, player,
+                             scaled_budget(engine, engines[engine]->budget),
+                             &search_cancel);
+        engine_counters(engine, &after);
+        search_ns = after.time_ns - before.time_ns;
+        stats_hist_add(HIST_SEARCH, search_ns);
+        trace_simrupt_search_end(player, move, after.nodes - before.nodes,
+                                 search_ns);
+        /* Closed while searching: the move is not played */
+        if (READ_ONCE(search_cancel)) {
+            atomic_set(&turn_state, TURN_IDLE);
+            return;
+        }
+    }
+    /* Before the last move of a game, stop the opponent's ponder search as
+     * well. Nothing is searching then, and no lock is held.
+     */
+    if (ends_game(move, player))
+        for (int i = 0; i < NR_ENGINES; i++)
+            ponder_stop(i);
 
-    /* Store data to the kfifo buffer */
+    /* Store data to the kfifo buffer. table, turn and chess only change
+     * under producer_lock.
+     */
     mutex_lock(&producer_lock);
+    if (move != -1)
+        table[move] = player;
+    record_add(move, player);
     produce_data(move);
+    ponder_start(engine);
     mutex_unlock(&producer_lock);
 
-    wake_up_interruptible(&rx_wait);
+    turn_ns = ktime_get_ns() - READ_ONCE(turn_tick_ns);
+    atomic_long_inc(&stats.moves);
+    stats_hist_add(HIST_TURN, turn_ns);
+    trace_simrupt_work_end(player, move, turn_ns);
+    adapt_turn(engine, search_ns, turn_ns);
+
+    /* Publishes turn to the next tick */
+    atomic_set_release(&turn_state, TURN_IDLE);
 }
 
-/* Workqueue for asynchronous bottom-half processing */
-static struct workqueue_struct *simrupt_workqueue;
+static void ai_func1(struct work_struct *w)
+{
+    ai_play(READ_ONCE(engine_x));
+}
+
+static void ai_func2(struct work_struct *w)
+{
+    ai_play(READ_ONCE(engine_o));
+}
 
 /* Work item: holds a pointer to the function that is going to be executed
  * asynchronously.
@@ -223,36 +755,218 @@ static DECLARE_WORK(ai_work2, ai_func2);
  */
 static void simrupt_tasklet_func(unsigned long __data)
 {
-    ktime_t tv_start, tv_end;
-    s64 nsecs;
+    u64 now;
 
     WARN_ON_ONCE(!in_interrupt());
     WARN_ON_ONCE(!in_softirq());
 
-    tv_start = ktime_get();
+    now = ktime_get_ns();
+    stats_hist_add(HIST_TASKLET, now - tick_ns);
+    if (atomic_cmpxchg(&turn_state, TURN_IDLE, TURN_QUEUED) != TURN_IDLE) {
+        atomic_long_inc(&stats.coalesced_ticks);
+        return;
+    }
+    trace_simrupt_tasklet(turn, now - tick_ns);
+    WRITE_ONCE(tasklet_ns, now);
+    WRITE_ONCE(turn_tick_ns, tick_ns);
     if (turn == 'X')
         schedule_work_on(0, &ai_work1);
     // queue_work_on(0, simrupt_workqueue, &ai_work1);
     else
         schedule_work_on(1, &ai_work2);
     // queue_work_on(1, simrupt_workqueue, &ai_work2);
-    tv_end = ktime_get();
-
-    nsecs = (s64) ktime_to_ns(ktime_sub(tv_end, tv_start));
-
-    pr_info("simrupt: [CPU#%d] %s in_softirq: %llu usec\n", smp_processor_id(),
-            __func__, (unsigned long long) nsecs >> 10);
 }
 
 /* Tasklet for asynchronous bottom-half processing in softirq context */
 static DECLARE_TASKLET_OLD(simrupt_tasklet, simrupt_tasklet_func);
 
+/* Move everything in fast_buf to the kfifo, a contiguous run at a time */
+static void storm_work_func(struct work_struct *w)
+{
+    stats_hist_add(HIST_WORK, ktime_get_ns() - READ_ONCE(tasklet_ns));
+
+    mutex_lock(&consumer_lock);
+    mutex_lock(&producer_lock);
+    for (;;) {
+        int head = smp_load_acquire(&fast_buf.head), tail = fast_buf.tail;
+        unsigned int n = CIRC_CNT_TO_END(head, tail, PAGE_SIZE);
+
+        if (!n)
+            break;
+        produce(fast_buf.buf + tail, n);
+        smp_store_release(&fast_buf.tail, (tail + n) & (PAGE_SIZE - 1));
+    }
+    mutex_unlock(&producer_lock);
+    mutex_unlock(&consumer_lock);
+}
+
+static DECLARE_WORK(storm_work, storm_work_func);
+
+/* The live game, put back once the replay is over */
+static struct {
+    int board_size, goal; /* pending geometry */
+    struct game_geometry geometry;
+    char table[N_GRIDS_MAX];
+    char turn;
+    struct simrupt_state state;
+} live;
+
+/* Called with producer_lock held */
+static void live_save(void)
+{
+    live.board_size = board_size;
+    live.goal = goal;
+    live.geometry = geometry;
+    memcpy(live.table, table, sizeof(table));
+    live.turn = turn;
+    read_state(&live.state);
+}
+
+/* Called with producer_lock held, while no search runs */
+static void live_restore(void)
+{
+    board_size = live.board_size;
+    goal = live.goal;
+    game_configure(live.geometry.size, live.geometry.goal);
+    memcpy(table, live.table, sizeof(table));
+    turn = live.turn;
+    draw_board();
+    write_seqlock(&state_lock);
+    game_state = live.state;
+    write_sequnlock(&state_lock);
+}
+
+/* Play the capture back from its starting position, on simrupt_workqueue.
+ * Waits are idle rather than uninterruptible, since the reader may stall
+ * the replay indefinitely.
+ */
+static void replay_func(struct work_struct *w)
+{
+    struct record_header hdr;
+    struct record_event ev;
+    u64 start;
+    int n = record_replay_begin(&hdr);
+
+    if (n < 0) {
+        pr_warn("simrupt: nothing to replay (%d)\n", n);
+        goto out;
+    }
+    mutex_lock(&producer_lock);
+    live_save();
+    board_size = hdr.board_size;
+    goal = hdr.goal;
+    game_configure(board_size, goal);
+    memcpy(table, hdr.board, N_GRIDS);
+    turn = hdr.turn;
+    draw_board();
+    mutex_unlock(&producer_lock);
+
+    start = ktime_get_ns();
+    for (int i = 0; i < n && !READ_ONCE(replay_cancel); i++) {
+        int move;
+
+        record_replay_event(i, &ev);
+        move = le16_to_cpu(ev.move);
+        /* Imported traces are not trusted, moves are never replayed out of
+         * the board or on a stone. Only this work writes the table meanwhile.
+         */
+        if (move >= N_GRIDS || (ev.player != 'X' && ev.player != 'O') ||
+            table[move] != ' ') {
+            atomic_long_inc(&stats.replay_skipped);
+            continue;
+        }
+        if (replay_mode == REPLAY_PACED) {
+            s64 wait = start + le64_to_cpu(ev.ns) - ktime_get_ns();
+
+            if (wait > 0)
+                wait_event_idle_timeout(replay_wait, READ_ONCE(replay_cancel),
+                                        nsecs_to_jiffies(wait));
+        } else {
+            /* Only the reader holds the replay back: nothing is dropped */
+            wait_event_idle(replay_wait,
+                            READ_ONCE(replay_cancel) ||
+                                kfifo_avail(&rx_fifo) >=
+                                    READ_ONCE(batch.len) + CHESS_LEN);
+            if (!(i & 63))
+                cond_resched();
+        }
+        if (READ_ONCE(replay_cancel))
+            break;
+
+        mutex_lock(&producer_lock);
+        turn = ev.player;
+        table[move] = turn;
+        produce_data(move);
+        mutex_unlock(&producer_lock);
+        atomic_long_inc(&stats.replay_moves);
+    }
+    /* The reader gets every frame before end of file */
+    mutex_lock(&producer_lock);
+    batch_flush();
+    live_restore();
+    mutex_unlock(&producer_lock);
+    record_replay_end();
+out:
+    stats_replay_stop();
+    WRITE_ONCE(replay_done, true);
+    wake_up_interruptible(&rx_wait);
+}
+
+static DECLARE_WORK(replay_work, replay_func);
+
+static void storm_tasklet_func(unsigned long __data)
+{
+    u64 now = ktime_get_ns();
+
+    stats_hist_add(HIST_TASKLET, now - READ_ONCE(tick_ns));
+    WRITE_ONCE(tasklet_ns, now);
+    queue_work(simrupt_workqueue, &storm_work);
+}
+
+static DECLARE_TASKLET_OLD(storm_tasklet, storm_tasklet_func);
+
+/* Interrupt half of the load generator: events that find fast_buf full are
+ * dropped, as a device would overrun its own buffer.
+ */
+static void storm_irq(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < storm; i++)
+        if (fast_buf_put(update_simrupt_data()))
+            break;
+    atomic_long_add(storm, &stats.storm_events);
+    if (i < storm)
+        atomic_long_add(storm - i, &stats.storm_drops);
+    tasklet_schedule(&storm_tasklet);
+}
+
+static struct hrtimer storm_timer;
+
+static enum hrtimer_restart storm_timer_func(struct hrtimer *hrtimer)
+{
+    unsigned long flags;
+    u64 missed, start;
+
+    local_irq_save(flags);
+    start = ktime_get_ns();
+    WRITE_ONCE(tick_ns, start);
+    storm_irq();
+    stats_hist_add(HIST_IRQ, ktime_get_ns() - start);
+    atomic_long_inc(&stats.ticks);
+    local_irq_restore(flags);
+
+    /* Periods that passed while the callback was late produced nothing */
+    missed = hrtimer_forward_now(hrtimer, us_to_ktime(storm_period)) - 1;
+    if (missed)
+        atomic_long_add(missed * storm, &stats.storm_missed);
+    return HRTIMER_RESTART;
+}
+
 static void process_data(void)
 {
     WARN_ON_ONCE(!irqs_disabled());
 
-    pr_info("simrupt: [CPU#%d] produce data\n", smp_processor_id());
-    pr_info("simrupt: [CPU#%d] scheduling tasklet\n", smp_processor_id());
     tasklet_schedule(&simrupt_tasklet);
 }
 
@@ -261,7 +975,6 @@ static void timer_handler(struct timer_list *__timer)
     ktime_t tv_start, tv_end;
     s64 nsecs;
 
-    pr_info("simrupt: [CPU#%d] enter %s\n", smp_processor_id(), __func__);
     /* We are using a kernel timer to simulate a hard-irq, so we must expect
      * to be in softirq context here.
      */
@@ -271,14 +984,19 @@ static void timer_handler(struct timer_list *__timer)
     local_irq_disable();
 
     tv_start = ktime_get();
-    process_data();
+    WRITE_ONCE(tick_ns, ktime_to_ns(tv_start));
+    if (storm)
+        storm_irq();
+    else
+        process_data();
     tv_end = ktime_get();
 
     nsecs = (s64) ktime_to_ns(ktime_sub(tv_end, tv_start));
 
-    pr_info("simrupt: [CPU#%d] %s in_irq: %llu usec\n", smp_processor_id(),
-            __func__, (unsigned long long) nsecs >> 10);
-    mod_timer(&timer, jiffies + msecs_to_jiffies(delay));
+    atomic_long_inc(&stats.ticks);
+    stats_hist_add(HIST_IRQ, nsecs);
+    trace_simrupt_timer(nsecs);
+    mod_timer(&timer, jiffies + msecs_to_jiffies(READ_ONCE(stats.tick_ms)));
 
     local_irq_enable();
 }
@@ -303,13 +1021,22 @@ static ssize_t simrupt_read(struct file *file,
         ret = kfifo_to_user(&rx_fifo, buf, count, &read);
         if (unlikely(ret < 0))
             break;
-        if (read)
+        if (read) {
+            atomic_long_add(read, &stats.read_bytes);
+            trace_simrupt_fifo_dequeue(read, kfifo_len(&rx_fifo));
+            if (wq_has_sleeper(&replay_wait))
+                wake_up(&replay_wait);
+            break;
+        }
+        /* The replay is over and the kfifo drained: end of file */
+        if (READ_ONCE(replay_done))
             break;
         if (file->f_flags & O_NONBLOCK) {
             ret = -EAGAIN;
             break;
         }
-        ret = wait_event_interruptible(rx_wait, kfifo_len(&rx_fifo));
+        ret = wait_event_interruptible(
+            rx_wait, kfifo_len(&rx_fifo) || READ_ONCE(replay_done));
     } while (ret == 0);
     pr_debug("simrupt: %s: out %u/%u bytes\n", __func__, read,
              kfifo_len(&rx_fifo));
@@ -321,13 +1048,78 @@ static ssize_t simrupt_read(struct file *file,
 
 static atomic_t open_cnt;
 
+/* Stop the game's searches and wait for them, once the timer and tasklet
+ * that queue them are gone.
+ */
+static void stop_searches(void)
+{
+    WRITE_ONCE(search_cancel, true);
+    cancel_work_sync(&ai_work1);
+    cancel_work_sync(&ai_work2);
+    atomic_set(&turn_state, TURN_IDLE);
+    for (int i = 0; i < NR_ENGINES; i++)
+        ponder_stop(i);
+    engines_reset();
+}
+
+/* Stop the replay, if any, and wait for it */
+static void stop_replay(void)
+{
+    WRITE_ONCE(replay_cancel, true);
+    wake_up(&replay_wait);
+    cancel_work_sync(&replay_work);
+}
+
+/* Bit 0 is set while a self-play tournament owns the engines */
+static unsigned long match_busy;
+
 static int simrupt_open(struct inode *inode, struct file *filp)
 {
+    int cnt;
+
     pr_debug("simrupt: %s\n", __func__);
-    if (atomic_inc_return(&open_cnt) == 1) {
-        mod_timer(&timer, jiffies + msecs_to_jiffies(delay));
-        pr_info("tic-tac-toe game start!\n");
+    cnt = atomic_inc_return(&open_cnt);
+    /* The engines keep global search state: no game during a tournament */
+    if (test_bit(0, &match_busy)) {
+        atomic_dec(&open_cnt);
+        return -EBUSY;
+    }
+    if (cnt == 1) {
+        WRITE_ONCE(search_cancel, false);
+        WRITE_ONCE(replay_done, false);
+        WRITE_ONCE(replay_mode, READ_ONCE(replay));
+        storm = replay_mode ? 0 : READ_ONCE(storm_burst);
+        storm_period = storm ? READ_ONCE(storm_period_us) : 0;
+        if (replay_mode) {
+            WRITE_ONCE(replay_cancel, false);
+            stats_replay_start();
+            pr_info("simrupt: replay start, %s\n", replay_names[replay_mode]);
+            queue_work(simrupt_workqueue, &replay_work);
+            goto out;
+        }
+        if (storm) {
+            stats_storm_start();
+            pr_info("simrupt: load generator start, %u events every %u us\n",
+                    storm,
+                    storm_period ?: (unsigned int) (READ_ONCE(stats.tick_ms) *
+                                                    USEC_PER_MSEC));
+        } else {
+            if (READ_ONCE(record)) {
+                mutex_lock(&producer_lock);
+                if (record_start(table, turn))
+                    pr_warn("simrupt: cannot capture this session\n");
+                mutex_unlock(&producer_lock);
+            }
+            pr_info("tic-tac-toe game start!\n");
+        }
+        if (storm_period)
+            hrtimer_start(&storm_timer, us_to_ktime(storm_period),
+                          HRTIMER_MODE_REL_HARD);
+        else
+            mod_timer(&timer,
+                      jiffies + msecs_to_jiffies(READ_ONCE(stats.tick_ms)));
     }
+out:
     pr_info("openm current cnt: %d\n", atomic_read(&open_cnt));
 
     return 0;
@@ -336,18 +1128,192 @@ static int simrupt_open(struct inode *inode, struct file *filp)
 static int simrupt_release(struct inode *inode, struct file *filp)
 {
     pr_debug("simrupt: %s\n", __func__);
-    if (atomic_dec_and_test(&open_cnt) == 0) {
+    if (atomic_dec_and_test(&open_cnt)) {
         del_timer_sync(&timer);
-        flush_workqueue(simrupt_workqueue);
+        hrtimer_cancel(&storm_timer);
+        tasklet_kill(&simrupt_tasklet);
+        tasklet_kill(&storm_tasklet);
+        cancel_work_sync(&storm_work);
+        stop_replay();
+        stop_searches();
+        record_stop();
         fast_buf_clear();
+        /* Deliver the frames still staged to the next reader */
+        cancel_delayed_work_sync(&batch_work);
+        mutex_lock(&producer_lock);
+        batch_flush();
+        mutex_unlock(&producer_lock);
+        if (storm || replay_mode) {
+            /* Leave no synthetic or replayed frames for the next reader */
+            kfifo_reset(&rx_fifo);
+        }
+        if (storm)
+            stats_storm_stop();
+        WRITE_ONCE(replay_mode, REPLAY_OFF);
     }
     pr_info("release, current cnt: %d\n", atomic_read(&open_cnt));
 
     return 0;
 }
 
+/* Self-play tournament between two engine configurations, triggered by
+ * writing "<engine:budget> <engine:budget> <games> [seed]" to the sysfs
+ * attribute while the device is closed, e.g.
+ *   echo "mcts:1000 negamax:4 100 42" > /sys/class/simrupt/simrupt/tournament
+ */
+static struct tournament match;
+static bool match_cancel; /* set on unload */
+
+/* Live games roll out from a random seed, so that they differ from one load
+ * to the next. The Zobrist keys were drawn from the fixed seed before, which
+ * keeps exported caches valid, and tournaments seed every game themselves.
+ */
+static void seed_rollouts(void)
+{
+    u64 seed[2];
+
+    get_random_bytes(seed, sizeof(seed));
+    xoro_seed(seed[0], seed[1] | 1); /* never the all-zero state */
+}
+
+static void tournament_func(struct work_struct *w)
+{
+    /* Results must not depend on the games played before */
+    engines_clear();
+    tournament_run(&match);
+    seed_rollouts();
+    clear_bit(0, &match_busy);
+}
+
+static DECLARE_WORK(tournament_work, tournament_func);
+
+static ssize_t tournament_show(struct device *dev,
+                               struct device_attribute *attr,
+                               char *buf)
+{
+    char a[32], b[32];
+    int score, ci;
+
+    engine_config_format(&match.a, a, sizeof(a));
+    engine_config_format(&match.b, b, sizeof(b));
+    tournament_score(&match, &score, &ci);
+    return sysfs_emit(
+        buf, "%s vs %s: %u/%u games +%u =%u -%u score %d +/- %d permille, "
+             "%llu/%llu ns per move%s\n",
+        a, b, match.played, match.games, match.wins, match.draws,
+        match.losses, score, ci,
+        match.moves[0] ? div64_u64(match.time_ns[0], match.moves[0]) : 0,
+        match.moves[1] ? div64_u64(match.time_ns[1], match.moves[1]) : 0,
+        test_bit(0, &match_busy) ? " (running)" : "");
+}
+
+static ssize_t tournament_store(struct device *dev,
+                                struct device_attribute *attr,
+                                const char *buf,
+                                size_t count)
+{
+    struct tournament t = {.seed = 1};
+    char a[32], b[32];
+
+    if (sscanf(buf, "%31s %31s %u %llu", a, b, &t.games, &t.seed) < 3 ||
+        engine_config_parse(&t.a, a) || engine_config_parse(&t.b, b) ||
+        !t.games)
+        return -EINVAL;
+
+    if (test_and_set_bit(0, &match_busy))
+        return -EBUSY;
+    if (atomic_read(&open_cnt)) {
+        clear_bit(0, &match_busy);
+        return -EBUSY;
+    }
+    match = t;
+    match.stop = &match_cancel;
+    queue_work(simrupt_workqueue, &tournament_work);
+
+    return count;
+}
+
+static DEVICE_ATTR_RW(tournament);
+
+/* Same snapshot as SIMRUPT_IOC_GET_STATE, without opening the device */
+static ssize_t state_show(struct device *dev,
+                          struct device_attribute *attr,
+                          char *buf)
+{
+    struct simrupt_state st;
+    char row[BOARD_SIZE_MAX + 1];
+    int len;
+
+    read_state(&st);
+    len = sysfs_emit(buf, "turn %c moves %u last_move %d games %u\n", st.turn,
+                     st.moves, st.last_move, st.games);
+    for (int i = 0; i < st.board_size; i++) {
+        for (int j = 0; j < st.board_size; j++) {
+            char c = st.board[i * st.board_size + j];
+            row[j] = c == ' ' ? '.' : c;
+        }
+        row[st.board_size] = '\0';
+        len += sysfs_emit_at(buf, len, "%s\n", row);
+    }
+    return len;
+}
+
+static DEVICE_ATTR_RO(state);
+
+static struct attribute *simrupt_attrs[] = {
+    &dev_attr_tournament.attr,
+    &dev_attr_state.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(simrupt);
+
+static long simrupt_ioctl(struct file *file,
+                          unsigned int cmd,
+                          unsigned long arg)
+{
+    struct simrupt_geometry geo;
+    struct simrupt_state st;
+
+    switch (cmd) {
+    case SIMRUPT_IOC_SET_GEOMETRY:
+        if (copy_from_user(&geo, (void __user *) arg, sizeof(geo)))
+            return -EFAULT;
+        if (game_check_geometry(geo.board_size, geo.goal))
+            return -EINVAL;
+        /* produce_data() reads both under producer_lock. A replay plays the
+         * geometry of its capture and then puts the live one back.
+         */
+        mutex_lock(&producer_lock);
+        if (READ_ONCE(replay_mode)) {
+            mutex_unlock(&producer_lock);
+            return -EBUSY;
+        }
+        board_size = geo.board_size;
+        goal = geo.goal;
+        mutex_unlock(&producer_lock);
+        return 0;
+    case SIMRUPT_IOC_GET_STATE:
+        read_state(&st);
+        if (copy_to_user((void __user *) arg, &st, sizeof(st)))
+            return -EFAULT;
+        return 0;
+    case SIMRUPT_IOC_GET_GEOMETRY:
+        mutex_lock(&producer_lock);
+        geo.board_size = BOARD_SIZE;
+        geo.goal = GOAL;
+        mutex_unlock(&producer_lock);
+        if (copy_to_user((void __user *) arg, &geo, sizeof(geo)))
+            return -EFAULT;
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
 static const struct file_operations simrupt_fops = {
     .read = simrupt_read,
+    .unlocked_ioctl = simrupt_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
     .llseek = no_llseek,
     .open = simrupt_open,  // cat /dev/simrupt
     .release = simrupt_release,
@@ -359,6 +1325,13 @@ static int __init simrupt_init(void)
     dev_t dev_id;
     int ret;
 
+    ret = game_configure(board_size, goal);
+    if (ret) {
+        pr_err("simrupt: invalid geometry %dx%d goal %d\n", board_size,
+               board_size, goal);
+        return ret;
+    }
+
     if (kfifo_alloc(&rx_fifo, PAGE_SIZE, GFP_KERNEL) < 0)
         return -ENOMEM;
 
@@ -389,7 +1362,8 @@ static int __init simrupt_init(void)
     }
 
     /* Register the device with sysfs */
-    device_create(simrupt_class, NULL, MKDEV(major, 0), NULL, DEV_NAME);
+    simrupt_device = device_create_with_groups(
+        simrupt_class, NULL, MKDEV(major, 0), NULL, simrupt_groups, DEV_NAME);
 
     /* Allocate fast circular buffer */
     fast_buf.buf = vmalloc(PAGE_SIZE);
@@ -412,12 +1386,34 @@ static int __init simrupt_init(void)
 
     /*Setup the chessboard*/
     init_board();
-    negamax_init();
-    memset(table, ' ', N_GRIDS);
+    engines_init();
+    seed_rollouts();
+    book_init(IS_ERR(simrupt_device) ? NULL : simrupt_device, book);
+    stats_init();
+    memset(table, ' ', N_GRIDS_MAX);
     turn = 'X';
+    game_state.board_size = BOARD_SIZE;
+    game_state.goal = GOAL;
+    game_state.last_move = -1;
+    game_state.turn = turn;
+    game_state.winner = ' ';
+    memcpy(game_state.board, table, N_GRIDS);
+    stats.tick_ms = delay;
+    for (int i = 0; i < NR_ENGINES; i++)
+        stats.budget_permille[i] = 1000;
+
+    for (int i = 0; i < NR_ENGINES; i++)
+        INIT_WORK(&ponder_slots[i].work, ponder_func);
 
     /* Setup the timer */
     timer_setup(&timer, timer_handler, 0);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(&storm_timer, storm_timer_func, CLOCK_MONOTONIC,
+                  HRTIMER_MODE_REL_HARD);
+#else
+    hrtimer_init(&storm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+    storm_timer.function = storm_timer_func;
+#endif
     atomic_set(&open_cnt, 0);
 
     pr_info("simrupt: registered new simrupt device: %d,%d\n", major, 0);
@@ -437,9 +1433,21 @@ static void __exit simrupt_exit(void)
     dev_t dev_id = MKDEV(major, 0);
 
     del_timer_sync(&timer);
+    hrtimer_cancel(&storm_timer);
     tasklet_kill(&simrupt_tasklet);
+    tasklet_kill(&storm_tasklet);
+    cancel_work_sync(&storm_work);
+    stop_replay();
+    stop_searches();
+    cancel_delayed_work_sync(&batch_work);
+    WRITE_ONCE(match_cancel, true);
+    cancel_work_sync(&tournament_work);
     flush_workqueue(simrupt_workqueue);
     destroy_workqueue(simrupt_workqueue);
+    stats_exit();
+    record_exit();
+    book_exit();
+    engines_exit();
     vfree(fast_buf.buf);
     device_destroy(simrupt_class, dev_id);
     class_destroy(simrupt_class);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* ioctl interface of /dev/simrupt, shared with userspace */
+
+struct simrupt_geometry {
+    __u32 board_size;
+    __u32 goal;
+};
+
+#define SIMRUPT_BOARD_MAX 256 /* cells of the largest board */
+
+/* Snapshot of the game as of the last published move */
+struct simrupt_state {
+    __u32 board_size;
+    __u32 goal;
+    __u32 moves;     /* moves played in the current game */
+    __s32 last_move; /* cell of the last move, -1 at the start of a game */
+    __u32 games;     /* games finished since the module was loaded */
+    char turn;       /* side to move, 'X' or 'O' */
+    char winner;     /* 'X', 'O' or 'D' for the last finished game, else ' ' */
+    __u8 reserved[2];
+    char board[SIMRUPT_BOARD_MAX]; /* row-major cells: ' ', 'X' or 'O' */
+};
+
+#define SIMRUPT_IOC_MAGIC 'S'
+
+/* Takes effect when the current game ends, -EBUSY during a replay */
+#define SIMRUPT_IOC_SET_GEOMETRY \
+    _IOW(SIMRUPT_IOC_MAGIC, 1, struct simrupt_geometry)
+/* Geometry of the game being played */
+#define SIMRUPT_IOC_GET_GEOMETRY \
+    _IOR(SIMRUPT_IOC_MAGIC, 2, struct simrupt_geometry)
+/* Current board, turn and move count, without reading the stream */
+#define SIMRUPT_IOC_GET_STATE _IOR(SIMRUPT_IOC_MAGIC, 3, struct simrupt_state)
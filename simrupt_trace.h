@@ -0,0 +1,141 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM simrupt
+
+#if !defined(_SIMRUPT_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _SIMRUPT_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#include "engine.h"
+
+/* clang-format off */
+TRACE_EVENT(simrupt_timer,
+    TP_PROTO(u64 irq_ns),
+    TP_ARGS(irq_ns),
+    TP_STRUCT__entry(
+        __field(u64, irq_ns)
+    ),
+    TP_fast_assign(
+        __entry->irq_ns = irq_ns;
+    ),
+    TP_printk("irq_ns=%llu", __entry->irq_ns)
+);
+
+DECLARE_EVENT_CLASS(simrupt_delay,
+    TP_PROTO(char player, u64 delay_ns),
+    TP_ARGS(player, delay_ns),
+    TP_STRUCT__entry(
+        __field(char, player)
+        __field(u64, delay_ns)
+    ),
+    TP_fast_assign(
+        __entry->player = player;
+        __entry->delay_ns = delay_ns;
+    ),
+    TP_printk("player=%c delay_ns=%llu", __entry->player, __entry->delay_ns)
+);
+
+/* Tasklet run, delay_ns since the timer fired */
+DEFINE_EVENT(simrupt_delay, simrupt_tasklet,
+    TP_PROTO(char player, u64 delay_ns),
+    TP_ARGS(player, delay_ns)
+);
+
+/* AI work item start, delay_ns since the tasklet queued it */
+DEFINE_EVENT(simrupt_delay, simrupt_work_start,
+    TP_PROTO(char player, u64 delay_ns),
+    TP_ARGS(player, delay_ns)
+);
+
+TRACE_EVENT(simrupt_work_end,
+    TP_PROTO(char player, int move, u64 turn_ns),
+    TP_ARGS(player, move, turn_ns),
+    TP_STRUCT__entry(
+        __field(char, player)
+        __field(int, move)
+        __field(u64, turn_ns)
+    ),
+    TP_fast_assign(
+        __entry->player = player;
+        __entry->move = move;
+        __entry->turn_ns = turn_ns;
+    ),
+    TP_printk("player=%c move=%d turn_ns=%llu", __entry->player,
+              __entry->move, __entry->turn_ns)
+);
+
+/* Export the values of the engine names to perf and trace-cmd */
+TRACE_DEFINE_ENUM(ENGINE_MCTS);
+TRACE_DEFINE_ENUM(ENGINE_NEGAMAX);
+TRACE_DEFINE_ENUM(ENGINE_PNS);
+
+TRACE_EVENT(simrupt_search_start,
+    TP_PROTO(char player, int engine),
+    TP_ARGS(player, engine),
+    TP_STRUCT__entry(
+        __field(char, player)
+        __field(int, engine)
+    ),
+    TP_fast_assign(
+        __entry->player = player;
+        __entry->engine = engine;
+    ),
+    TP_printk("player=%c engine=%s", __entry->player,
+              __print_symbolic(__entry->engine,
+                               { ENGINE_MCTS, "mcts" },
+                               { ENGINE_NEGAMAX, "negamax" },
+                               { ENGINE_PNS, "pns" }))
+);
+
+TRACE_EVENT(simrupt_search_end,
+    TP_PROTO(char player, int move, unsigned long nodes, u64 ns),
+    TP_ARGS(player, move, nodes, ns),
+    TP_STRUCT__entry(
+        __field(char, player)
+        __field(int, move)
+        __field(unsigned long, nodes)
+        __field(u64, ns)
+    ),
+    TP_fast_assign(
+        __entry->player = player;
+        __entry->move = move;
+        __entry->nodes = nodes;
+        __entry->ns = ns;
+    ),
+    TP_printk("player=%c move=%d nodes=%lu ns=%llu", __entry->player,
+              __entry->move, __entry->nodes, __entry->ns)
+);
+
+DECLARE_EVENT_CLASS(simrupt_fifo,
+    TP_PROTO(unsigned int len, unsigned int used),
+    TP_ARGS(len, used),
+    TP_STRUCT__entry(
+        __field(unsigned int, len)
+        __field(unsigned int, used)
+    ),
+    TP_fast_assign(
+        __entry->len = len;
+        __entry->used = used;
+    ),
+    TP_printk("len=%u used=%u", __entry->len, __entry->used)
+);
+
+DEFINE_EVENT(simrupt_fifo, simrupt_fifo_enqueue,
+    TP_PROTO(unsigned int len, unsigned int used),
+    TP_ARGS(len, used)
+);
+
+DEFINE_EVENT(simrupt_fifo, simrupt_fifo_dequeue,
+    TP_PROTO(unsigned int len, unsigned int used),
+    TP_ARGS(len, used)
+);
+/* clang-format on */
+
+#endif /* _SIMRUPT_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE simrupt_trace
+#include <trace/define_trace.h>
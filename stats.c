@@ -0,0 +1,187 @@
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/seq_file.h>
+
+#include "cache.h"
+#include "mcts.h"
+#include "negamax.h"
+#include "pns.h"
+#include "record.h"
+#include "stats.h"
+#include "zobrist.h"
+
+struct simrupt_stats stats;
+
+static struct dentry *stats_dir;
+
+static const char *const hist_names[NR_HISTS] = {
+    [HIST_IRQ] = "irq",
+    [HIST_TASKLET] = "tasklet",
+    [HIST_WORK] = "work",
+    [HIST_SEARCH] = "search",
+    [HIST_TURN] = "turn",
+};
+
+/* Counters of the last load-generator session and their rates */
+static void storm_show(struct seq_file *m)
+{
+    u64 end = READ_ONCE(stats.storm_end_ns) ?: ktime_get_ns();
+    u64 ms = max_t(u64, (end - stats.storm_start_ns) / NSEC_PER_MSEC, 1);
+    long events = atomic_long_read(&stats.storm_events);
+    long drops = atomic_long_read(&stats.storm_drops);
+    long fifo_drops = atomic_long_read(&stats.dropped_bytes);
+    long read = atomic_long_read(&stats.read_bytes);
+
+    seq_printf(m, "storm_ms: %llu\n", ms);
+    seq_printf(m, "storm_events: %ld\n", events);
+    seq_printf(m, "storm_drops: %ld\n", drops);
+    seq_printf(m, "storm_missed: %ld\n",
+               atomic_long_read(&stats.storm_missed));
+    seq_printf(m, "storm_events_per_sec: %llu\n",
+               div64_u64((u64) events * MSEC_PER_SEC, ms));
+    seq_printf(m, "storm_fifo_per_sec: %llu\n",
+               div64_u64((u64) (events - drops - fifo_drops) * MSEC_PER_SEC,
+                         ms));
+    seq_printf(m, "storm_read_per_sec: %llu\n",
+               div64_u64((u64) read * MSEC_PER_SEC, ms));
+}
+
+/* Counters of the last replay and its rates */
+static void replay_show(struct seq_file *m)
+{
+    u64 end = READ_ONCE(stats.replay_end_ns) ?: ktime_get_ns();
+    u64 ms = max_t(u64, (end - stats.replay_start_ns) / NSEC_PER_MSEC, 1);
+    long moves = atomic_long_read(&stats.replay_moves);
+    long read = atomic_long_read(&stats.read_bytes);
+
+    seq_printf(m, "replay_ms: %llu\n", ms);
+    seq_printf(m, "replay_moves: %ld\n", moves);
+    seq_printf(m, "replay_skipped: %ld\n",
+               atomic_long_read(&stats.replay_skipped));
+    seq_printf(m, "replay_moves_per_sec: %llu\n",
+               div64_u64((u64) moves * MSEC_PER_SEC, ms));
+    seq_printf(m, "replay_read_per_sec: %llu\n",
+               div64_u64((u64) read * MSEC_PER_SEC, ms));
+}
+
+static int stats_show(struct seq_file *m, void *v)
+{
+    seq_printf(m, "moves: %ld\n", atomic_long_read(&stats.moves));
+    seq_printf(m, "book_hits: %ld\n", atomic_long_read(&stats.book_hits));
+    seq_printf(m, "dropped_bytes: %ld\n",
+               atomic_long_read(&stats.dropped_bytes));
+    seq_printf(m, "fifo_high_water: %u\n", READ_ONCE(stats.fifo_high));
+    seq_printf(m, "ticks: %ld\n", atomic_long_read(&stats.ticks));
+    seq_printf(m, "coalesced_ticks: %ld\n",
+               atomic_long_read(&stats.coalesced_ticks));
+    seq_printf(m, "overruns: %ld\n", atomic_long_read(&stats.overruns));
+    seq_printf(m, "tick_ms: %u\n", READ_ONCE(stats.tick_ms));
+    for (int e = 0; e < NR_ENGINES; e++)
+        seq_printf(m, "budget_permille_%s: %u\n", engines[e]->name,
+                   READ_ONCE(stats.budget_permille[e]));
+    for (int e = 0; e < NR_ENGINES; e++) {
+        struct engine_counters c;
+
+        engine_counters(e, &c);
+        seq_printf(m,
+                   "engine_%s: searches %lu nodes %lu rollouts %lu "
+                   "time_ns %llu memory %zu\n",
+                   engines[e]->name, c.searches, c.nodes, c.rollouts,
+                   c.time_ns, c.memory);
+    }
+    seq_printf(m, "tt_lookups: %lu\n", zobrist_stats.lookups);
+    seq_printf(m, "tt_hits: %lu\n", zobrist_stats.hits);
+    seq_printf(m, "tt_released: %lu\n", zobrist_stats.released);
+    seq_printf(m, "negamax_nodes: %lu\n", negamax_stats.nodes);
+    seq_printf(m, "negamax_searches: %lu\n", negamax_stats.searches);
+    seq_printf(m, "mcts_iterations: %lu\n", mcts_stats.iterations);
+    seq_printf(m, "mcts_rollouts: %lu\n", mcts_stats.rollouts);
+    seq_printf(m, "mcts_ponder_iterations: %lu\n",
+               mcts_stats.ponder_iterations);
+    seq_printf(m, "mcts_reused_visits: %lu\n", mcts_stats.reused_visits);
+    seq_printf(m, "mcts_early_stops: %lu\n", mcts_stats.early_stops);
+    seq_printf(m, "mcts_saved_iterations: %lu\n",
+               mcts_stats.saved_iterations);
+    seq_printf(m, "negamax_ponder_hits: %lu\n", negamax_stats.ponder_hits);
+    seq_printf(m, "pns_nodes: %lu\n", pns_stats.nodes);
+    seq_printf(m, "pns_solved: %lu\n", pns_stats.solved);
+    seq_printf(m, "pns_unsolved: %lu\n", pns_stats.unsolved);
+    seq_printf(m, "pns_instant: %lu\n", pns_stats.instant);
+    seq_printf(m, "cache_hits: %lu\n", cache_stats.hits);
+    seq_printf(m, "cache_misses: %lu\n", cache_stats.misses);
+    seq_printf(m, "cache_stores: %lu\n", cache_stats.stores);
+    seq_printf(m, "record_events: %lu\n", record_stats.events);
+    seq_printf(m, "record_overflows: %lu\n", record_stats.overflows);
+
+    seq_printf(m, "read_bytes: %ld\n", atomic_long_read(&stats.read_bytes));
+    seq_printf(m, "fifo_batches: %ld\n",
+               atomic_long_read(&stats.fifo_batches));
+    if (READ_ONCE(stats.storm_start_ns))
+        storm_show(m);
+    if (READ_ONCE(stats.replay_start_ns))
+        replay_show(m);
+
+    for (int h = 0; h < NR_HISTS; h++) {
+        seq_printf(m, "\n%s latency (ns):\n", hist_names[h]);
+        for (int i = 0; i < HIST_BUCKETS; i++) {
+            long count = atomic_long_read(&stats.hist[h][i]);
+            if (count)
+                seq_printf(m, "%20llu %ld\n", 1ULL << i, count);
+        }
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(stats);
+
+/* Rates are measured from a clean slate for each session */
+void stats_storm_start(void)
+{
+    atomic_long_set(&stats.storm_events, 0);
+    atomic_long_set(&stats.storm_drops, 0);
+    atomic_long_set(&stats.storm_missed, 0);
+    atomic_long_set(&stats.dropped_bytes, 0);
+    atomic_long_set(&stats.read_bytes, 0);
+    atomic_long_set(&stats.fifo_batches, 0);
+    WRITE_ONCE(stats.storm_end_ns, 0);
+    WRITE_ONCE(stats.storm_start_ns, ktime_get_ns());
+}
+
+void stats_storm_stop(void)
+{
+    WRITE_ONCE(stats.storm_end_ns, ktime_get_ns());
+}
+
+void stats_replay_start(void)
+{
+    atomic_long_set(&stats.replay_moves, 0);
+    atomic_long_set(&stats.replay_skipped, 0);
+    atomic_long_set(&stats.dropped_bytes, 0);
+    atomic_long_set(&stats.read_bytes, 0);
+    atomic_long_set(&stats.fifo_batches, 0);
+    WRITE_ONCE(stats.replay_end_ns, 0);
+    WRITE_ONCE(stats.replay_start_ns, ktime_get_ns());
+}
+
+void stats_replay_stop(void)
+{
+    WRITE_ONCE(stats.replay_end_ns, ktime_get_ns());
+}
+
+void stats_init(void)
+{
+    stats_dir = debugfs_create_dir("simrupt", NULL);
+    debugfs_create_file("stats", 0444, stats_dir, NULL, &stats_fops);
+    debugfs_create_file_size("cache", 0600, stats_dir, NULL, &cache_fops,
+                             CACHE_BLOB_SIZE);
+    debugfs_create_file("record", 0600, stats_dir, NULL, &record_fops);
+}
+
+void stats_exit(void)
+{
+    debugfs_remove_recursive(stats_dir);
+}
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/types.h>
+
+#include "tournament.h"
+
+/* Latency histograms, bucket i counts durations in [2^i, 2^(i+1)) ns */
+enum simrupt_hist {
+    HIST_IRQ,     /* timer_handler() with interrupts disabled */
+    HIST_TASKLET, /* timer fire to tasklet */
+    HIST_WORK,    /* tasklet to AI work item start */
+    HIST_SEARCH,  /* engine search */
+    HIST_TURN,    /* timer fire to move in the FIFO */
+    NR_HISTS,
+};
+
+#define HIST_BUCKETS 64
+
+struct simrupt_stats {
+    atomic_long_t hist[NR_HISTS][HIST_BUCKETS];
+    atomic_long_t moves;
+    atomic_long_t book_hits;
+    atomic_long_t dropped_bytes;
+    atomic_long_t ticks;
+    atomic_long_t coalesced_ticks; /* ticks that found the last turn running */
+    atomic_long_t overruns;        /* turns longer than the tick period */
+    unsigned int fifo_high;        /* updated under producer_lock */
+    atomic_long_t read_bytes;      /* returned by read() */
+    atomic_long_t fifo_batches;    /* copies to the kfifo, see batch_ms */
+
+    /* Load generator, see storm_burst */
+    atomic_long_t storm_events; /* produced by the interrupt */
+    atomic_long_t storm_drops;  /* lost to a full fast_buf */
+    atomic_long_t storm_missed; /* not produced, the hrtimer ran late */
+    u64 storm_start_ns, storm_end_ns;
+
+    /* Replay of a capture, see the replay parameter */
+    atomic_long_t replay_moves;   /* produced */
+    atomic_long_t replay_skipped; /* invalid moves of an imported capture */
+    u64 replay_start_ns, replay_end_ns;
+
+    /* Pacing of the game, see the adaptive parameter */
+    unsigned int tick_ms;
+    unsigned int budget_permille[NR_ENGINES];
+};
+
+extern struct simrupt_stats stats;
+
+static inline void stats_hist_add(enum simrupt_hist h, u64 ns)
+{
+    atomic_long_inc(&stats.hist[h][ns ? fls64(ns) - 1 : 0]);
+}
+
+void stats_storm_start(void);
+void stats_storm_stop(void);
+void stats_replay_start(void);
+void stats_replay_stop(void);
+void stats_init(void);
+void stats_exit(void);
@@ -0,0 +1,236 @@
+/* bench: measure the engines in userspace over fixed position suites.
+ *
+ * Each suite is a deterministic set of positions reached by random play from
+ * the empty board, so results are comparable between builds. Suites are
+ * defined by how full the board is, so they scale with the geometry. For every
+ * engine and suite the harness reports per-move latency percentiles, search
+ * throughput and the transposition table hit rate.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "engine.h"
+#include "game.h"
+#include "mcts.h"
+#include "negamax.h"
+#include "pns.h"
+#include "xoroshiro128.h"
+#include "zobrist.h"
+
+struct suite {
+    const char *name;
+    int min_fill, max_fill; /* percentage of occupied cells */
+};
+
+static const struct suite suites[] = {
+    {"opening", 0, 15},
+    {"midgame", 25, 45},
+    {"endgame", 57, 75},
+};
+
+struct position {
+    char table[N_GRIDS_MAX];
+    char player;
+};
+
+static u64 suite_state;
+
+static u64 suite_rand(void)
+{
+    /* Independent of the engine RNG, so suites never change with it */
+    suite_state = suite_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return suite_state >> 33;
+}
+
+static void make_position(struct position *pos, const struct suite *s)
+{
+    int lo = s->min_fill * N_GRIDS / 100, hi = s->max_fill * N_GRIDS / 100;
+    int stones = lo + suite_rand() % (hi - lo + 1);
+retry:
+    memset(pos->table, ' ', N_GRIDS);
+    pos->player = 'X';
+    for (int n = 0; n < stones; n++) {
+        int empty[N_GRIDS_MAX], n_empty = 0, k;
+        for_each_empty_grid (i, pos->table)
+            empty[n_empty++] = i;
+        /* Take the first cell from a random start that keeps the game open */
+        int start = suite_rand() % n_empty;
+        for (k = 0; k < n_empty; k++) {
+            int move = empty[(start + k) % n_empty];
+            pos->table[move] = pos->player;
+            if (check_win(pos->table) == ' ')
+                break;
+            pos->table[move] = ' ';
+        }
+        if (k == n_empty)
+            goto retry;
+        pos->player ^= 'O' ^ 'X';
+    }
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, int p)
+{
+    int idx = (n * p + 99) / 100 - 1;
+    return sorted[idx < 0 ? 0 : idx];
+}
+
+static void run_suite(int engine,
+                      const struct suite *s,
+                      int n_positions,
+                      int reps)
+{
+    int n = n_positions * reps;
+    double *lat = malloc(n * sizeof(*lat));
+    struct mcts_stats m0 = mcts_stats;
+    struct negamax_stats n0 = negamax_stats;
+    struct zobrist_stats z0 = zobrist_stats;
+    struct pns_stats p0 = pns_stats;
+    double total = 0;
+    int k = 0;
+
+    if (!lat) {
+        perror("malloc");
+        exit(1);
+    }
+
+    suite_state = 0x5eed0000 + (s - suites);
+    for (int p = 0; p < n_positions; p++) {
+        struct position pos;
+        make_position(&pos, s);
+        for (int r = 0; r < reps; r++) {
+            char table[N_GRIDS_MAX];
+            memcpy(table, pos.table, N_GRIDS);
+            double t0 = now_us();
+            engine_search(engine, table, pos.player, engines[engine]->budget,
+                          NULL);
+            lat[k] = now_us() - t0;
+            total += lat[k++];
+        }
+    }
+    qsort(lat, n, sizeof(*lat), cmp_double);
+
+    printf("%-8s %-8s %5d %9.2f %9.2f %9.2f %9.2f", engines[engine]->name,
+           s->name, n,
+           percentile(lat, n, 50) / 1e3, percentile(lat, n, 90) / 1e3,
+           percentile(lat, n, 99) / 1e3, lat[n - 1] / 1e3);
+    if (engine == ENGINE_MCTS) {
+        printf(" %12.0f rollouts/s    saved %5.1f%% (%lu early stops)\n",
+               (mcts_stats.rollouts - m0.rollouts) / (total / 1e6),
+               100.0 * (mcts_stats.saved_iterations - m0.saved_iterations) /
+                   ((unsigned long) n * ITERATIONS),
+               mcts_stats.early_stops - m0.early_stops);
+    } else if (engine == ENGINE_PNS) {
+        unsigned long nodes = pns_stats.nodes - p0.nodes;
+        printf(" %12.0f nodes/s %8lu nodes/move    solved %5.1f%%"
+               " (%lu instant)\n",
+               nodes / (total / 1e6), nodes / n,
+               100.0 * (pns_stats.solved - p0.solved) / n,
+               pns_stats.instant - p0.instant);
+    } else {
+        unsigned long lookups = zobrist_stats.lookups - z0.lookups;
+        unsigned long hits = zobrist_stats.hits - z0.hits;
+        unsigned long nodes = negamax_stats.nodes - n0.nodes;
+        unsigned long searches = negamax_stats.searches - n0.searches;
+        printf(" %12.0f nodes/s %8lu nodes/move %5.1f searches/move"
+               "    TT hit %5.1f%%\n",
+               nodes / (total / 1e6), nodes / n, (double) searches / n,
+               lookups ? 100.0 * hits / lookups : 0.0);
+    }
+    free(lat);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-e mcts|negamax|pns|all] [-n positions] [-r reps] "
+            "[-s seed] [-S board_size] [-G goal]\n"
+            "       [-d pvs|aspiration|mtdf] [-t tt_kb]\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int selected = (1U << NR_ENGINES) - 1; /* bit per ENGINE_* */
+    int n_positions = 8, reps = 1;
+    unsigned long long seed = 1;
+    int size = DEFAULT_BOARD_SIZE, goal = DEFAULT_GOAL;
+    unsigned long tt_kb = TT_DEFAULT_KB;
+    int opt, d;
+
+    while ((opt = getopt(argc, argv, "e:n:r:s:S:G:d:t:")) != -1) {
+        switch (opt) {
+        case 'e':
+            if (strcmp(optarg, "all")) {
+                int e = engine_find(optarg);
+
+                if (e < 0)
+                    usage(argv[0]);
+                selected = 1U << e;
+            }
+            break;
+        case 'n':
+            n_positions = atoi(optarg);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'S':
+            size = atoi(optarg);
+            break;
+        case 'G':
+            goal = atoi(optarg);
+            break;
+        case 'd':
+            for (d = 0; d < NR_NEGAMAX_DRIVERS; d++)
+                if (!strcmp(optarg, negamax_driver_names[d]))
+                    break;
+            if (d == NR_NEGAMAX_DRIVERS)
+                usage(argv[0]);
+            negamax_driver = d;
+            break;
+        case 't':
+            tt_kb = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (n_positions <= 0 || reps <= 0 || tt_kb > TT_MAX_KB ||
+        game_configure(size, goal))
+        usage(argv[0]);
+
+    zobrist_resize(tt_kb << 10);
+    engines_init();
+    xoro_seed(seed, 1618033989);
+
+    printf("%-8s %-8s %5s %9s %9s %9s %9s %12s\n", "engine", "suite",
+           "moves", "p50(ms)", "p90(ms)", "p99(ms)", "max(ms)", "throughput");
+    for (int e = 0; e < NR_ENGINES; e++) {
+        if (!(selected & (1U << e)))
+            continue;
+        for (size_t i = 0; i < ARRAY_SIZE(suites); i++)
+            run_suite(e, &suites[i], n_positions, reps);
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+/* Minimal subset of the kernel API used by the engine sources (the
+ * USER_SRCS of the Makefile: game.c, mcts.c, negamax.c, pns.c, eval.c,
+ * cache.c, zobrist.c, engine.c, tournament.c and xoroshiro128.c), so that
+ * they can be built unmodified as a userspace library. The headers under
+ * linux/ only forward here.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef uint8_t __u8;
+typedef int8_t __s8;
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+typedef uint16_t __le16;
+typedef uint32_t __le32;
+typedef uint64_t __le64;
+
+/* The userspace build only targets little-endian hosts */
+#define le32_to_cpu(x) ((u32) (x))
+#define cpu_to_le32(x) ((__le32) (x))
+#define le64_to_cpu(x) ((u64) (x))
+#define cpu_to_le64(x) ((__le64) (x))
+
+#define MODULE_LICENSE(x)
+#define EXPORT_SYMBOL(x)
+
+#define READ_ONCE(x) (*(const volatile typeof(x) *) &(x))
+#define WRITE_ONCE(x, val) (*(volatile typeof(x) *) &(x) = (val))
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define container_of(ptr, type, member) \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+#define swap(a, b)              \
+    do {                        \
+        typeof(a) __tmp = (a);  \
+        (a) = (b);              \
+        (b) = __tmp;            \
+    } while (0)
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(type, a, b) min((type) (a), (type) (b))
+#define max_t(type, a, b) max((type) (a), (type) (b))
+#define clamp_t(type, val, lo, hi) min_t(type, max_t(type, val, lo), hi)
+
+#define pr_info(...) fprintf(stderr, __VA_ARGS__)
+#define pr_warn(...) fprintf(stderr, __VA_ARGS__)
+#define pr_err(...) fprintf(stderr, __VA_ARGS__)
+#define pr_debug(...) \
+    do {              \
+    } while (0)
+
+/* Memory allocation */
+#define GFP_KERNEL 0
+#define __GFP_NOWARN 0
+#define kmalloc(size, flags) malloc(size)
+#define kzalloc(size, flags) calloc(1, size)
+#define kcalloc(n, size, flags) calloc(n, size)
+#define kmalloc_array(n, size, flags) calloc(n, size)
+#define kvmalloc(size, flags) malloc(size)
+#define kvmalloc_array(n, size, flags) calloc(n, size)
+#define kvcalloc(n, size, flags) calloc(n, size)
+#define kfree(ptr) free(ptr)
+#define kvfree(ptr) free(ptr)
+
+/* Locking: the userspace build is single-threaded */
+struct mutex {
+    int locked;
+};
+
+#define DEFINE_MUTEX(name) struct mutex name = {0}
+#define mutex_lock(lock) ((void) (lock))
+#define mutex_unlock(lock) ((void) (lock))
+#define mutex_trylock(lock) 1
+
+/* Equal strings, either one may end with a newline */
+static inline bool sysfs_streq(const char *s1, const char *s2)
+{
+    while (*s1 && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+    if (*s1 == *s2)
+        return true;
+    if (!*s1 && *s2 == '\n' && !s2[1])
+        return true;
+    return *s1 == '\n' && !s1[1] && !*s2;
+}
+
+/* Time and scheduling */
+#include <time.h>
+
+#define BITS_PER_LONG (8 * sizeof(long))
+
+static inline u64 ktime_get_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void cond_resched(void) {}
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+    return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+    return dividend / divisor;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+/* Userspace already has the real error numbers */
+#include_next <linux/errno.h>
@@ -0,0 +1,277 @@
+/* gen-book: solve small boards exhaustively and emit an opening book /
+ * endgame tablebase that simrupt loads through request_firmware().
+ *
+ * Every reachable position with at most OPENING stones or at most ENDGAME
+ * empty squares is stored once, under the base-3 encoding of its canonical
+ * orientation (minimum over the 8 symmetries of the square), together with
+ * the best move and its exact game-theoretic value.
+ */
+
+#include <endian.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../book.h"
+
+#define UNKNOWN INT8_MAX
+
+static int size = 4, goal = 3, allow_exceed = 1;
+static int n_grids;
+static int max_opening = 4, max_endgame = 4;
+
+static uint32_t pow3[BOOK_MAX_GRIDS];
+static uint8_t sym_src[8][BOOK_MAX_GRIDS];
+static int8_t *memo;    /* value of a position for the side to move */
+static uint8_t *seen;   /* positions already visited by the emitter */
+
+static struct book_entry *entries;
+static size_t n_entries, cap_entries;
+
+static int symmetry_src(int t, int idx)
+{
+    int r = idx / size, c = idx % size;
+    if (t & 4) {
+        int tmp = r;
+        r = c;
+        c = tmp;
+    }
+    if (t & 2)
+        r = size - 1 - r;
+    if (t & 1)
+        c = size - 1 - c;
+    return r * size + c;
+}
+
+static uint32_t encode(const char *t, int sym)
+{
+    uint32_t key = 0;
+    for (int i = 0; i < n_grids; i++) {
+        char v = t[sym_src[sym][i]];
+        key += pow3[i] * (v == 'X' ? 1 : v == 'O' ? 2 : 0);
+    }
+    return key;
+}
+
+static char cell(const char *t, int r, int c)
+{
+    if (r < 0 || c < 0 || r >= size || c >= size)
+        return ' ';
+    return t[r * size + c];
+}
+
+/* Same rules as check_win() in game.c */
+static char check_win(const char *t)
+{
+    static const int dirs[4][2] = {{1, 0}, {0, 1}, {1, 1}, {1, -1}};
+    for (int d = 0; d < 4; d++) {
+        int di = dirs[d][0], dj = dirs[d][1];
+        for (int i = 0; i < size; i++) {
+            for (int j = 0; j < size; j++) {
+                char last = cell(t, i, j);
+                int k;
+                if (last == ' ')
+                    continue;
+                for (k = 1; k < goal; k++)
+                    if (cell(t, i + k * di, j + k * dj) != last)
+                        break;
+                if (k < goal)
+                    continue;
+                if (!allow_exceed &&
+                    (cell(t, i - di, j - dj) == last ||
+                     cell(t, i + goal * di, j + goal * dj) == last))
+                    continue;
+                return last;
+            }
+        }
+    }
+    for (int i = 0; i < n_grids; i++)
+        if (t[i] == ' ')
+            return ' ';
+    return 'D';
+}
+
+/* Negamax over the whole game tree. A win k plies ahead scores
+ * BOOK_WIN + 1 - k so that the fastest win and the slowest loss are preferred.
+ */
+static int solve(char *t, char player, int *best)
+{
+    uint32_t key = encode(t, 0);
+    if (!best && memo[key] != UNKNOWN)
+        return memo[key];
+
+    int best_score = -127, best_move = -1;
+    for (int i = 0; i < n_grids; i++) {
+        if (t[i] != ' ')
+            continue;
+        int score;
+        t[i] = player;
+        char win = check_win(t);
+        if (win == player)
+            score = BOOK_WIN;
+        else if (win == 'D')
+            score = 0;
+        else {
+            score = -solve(t, player ^ 'O' ^ 'X', NULL);
+            if (score > 0)
+                score--;
+            else if (score < 0)
+                score++;
+        }
+        t[i] = ' ';
+        if (score > best_score) {
+            best_score = score;
+            best_move = i;
+        }
+    }
+    memo[key] = best_score;
+    if (best)
+        *best = best_move;
+    return best_score;
+}
+
+static void emit(char *t, char player, int stones)
+{
+    uint32_t key = encode(t, 0);
+    if (seen[key])
+        return;
+    seen[key] = 1;
+
+    int empties = n_grids - stones;
+    if (stones <= max_opening || empties <= max_endgame) {
+        uint32_t canonical = key;
+        for (int s = 1; s < 8; s++) {
+            uint32_t k = encode(t, s);
+            if (k < canonical)
+                canonical = k;
+        }
+        if (canonical == key) {
+            int move;
+            int score = solve(t, player, &move);
+            if (n_entries == cap_entries) {
+                cap_entries = cap_entries ? cap_entries * 2 : 4096;
+                entries = realloc(entries, cap_entries * sizeof(*entries));
+                if (!entries) {
+                    perror("realloc");
+                    exit(1);
+                }
+            }
+            entries[n_entries++] = (struct book_entry){
+                .key = key, .move = move, .score = score};
+        }
+    }
+
+    for (int i = 0; i < n_grids; i++) {
+        if (t[i] != ' ')
+            continue;
+        t[i] = player;
+        if (check_win(t) == ' ')
+            emit(t, player ^ 'O' ^ 'X', stones + 1);
+        t[i] = ' ';
+    }
+}
+
+static int cmp_entries(const void *a, const void *b)
+{
+    uint32_t ka = ((const struct book_entry *) a)->key;
+    uint32_t kb = ((const struct book_entry *) b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-s size] [-g goal] [-e allow_exceed] "
+            "[-b opening_stones] [-n endgame_empties] -o output\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:g:e:b:n:o:")) != -1) {
+        switch (opt) {
+        case 's':
+            size = atoi(optarg);
+            break;
+        case 'g':
+            goal = atoi(optarg);
+            break;
+        case 'e':
+            allow_exceed = !!atoi(optarg);
+            break;
+        case 'b':
+            max_opening = atoi(optarg);
+            break;
+        case 'n':
+            max_endgame = atoi(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (!output)
+        usage(argv[0]);
+
+    n_grids = size * size;
+    if (size <= 0 || n_grids > BOOK_MAX_GRIDS || goal <= 0 || goal > size) {
+        fprintf(stderr, "unsupported geometry %dx%d goal %d\n", size, size,
+                goal);
+        return 1;
+    }
+
+    pow3[0] = 1;
+    for (int i = 1; i < n_grids; i++)
+        pow3[i] = pow3[i - 1] * 3;
+    for (int t = 0; t < 8; t++)
+        for (int i = 0; i < n_grids; i++)
+            sym_src[t][i] = symmetry_src(t, i);
+    size_t n_keys = (size_t) pow3[n_grids - 1] * 3;
+    memo = malloc(n_keys);
+    seen = calloc(n_keys, 1);
+    if (!memo || !seen) {
+        perror("malloc");
+        return 1;
+    }
+    memset(memo, UNKNOWN, n_keys);
+
+    char table[BOOK_MAX_GRIDS];
+    memset(table, ' ', n_grids);
+    emit(table, 'X', 0);
+    qsort(entries, n_entries, sizeof(*entries), cmp_entries);
+    /* Sorted on the host values, stored little-endian */
+    for (size_t i = 0; i < n_entries; i++)
+        entries[i].key = htole32(entries[i].key);
+
+    struct book_header hdr = {
+        .magic = BOOK_MAGIC,
+        .version = BOOK_VERSION,
+        .board_size = size,
+        .goal = goal,
+        .allow_exceed = allow_exceed,
+        .n_entries = htole32(n_entries),
+    };
+    FILE *fp = fopen(output, "wb");
+    if (!fp) {
+        perror(output);
+        return 1;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(entries, sizeof(*entries), n_entries, fp) != n_entries) {
+        perror(output);
+        return 1;
+    }
+    fclose(fp);
+
+    printf("%s: %zu positions, root value %d\n", output, n_entries,
+           memo[0]);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/* tournament: deterministic self-play between two engine configurations.
+ *
+ * Plays a fixed number of games, alternating colors, with rollouts seeded
+ * from the game number, and reports the score of the first configuration
+ * with its 95% confidence interval together with the average search time
+ * per move of both sides.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "game.h"
+#include "tournament.h"
+
+static char blob[CACHE_BLOB_SIZE];
+
+/* A missing file is an empty cache */
+static int cache_load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    size_t len;
+
+    if (!f)
+        return 0;
+    len = fread(blob, 1, sizeof(blob), f);
+    fclose(f);
+    if (len != sizeof(blob) || cache_import(blob, 0, len) < 0) {
+        fprintf(stderr, "%s: not a cache of this build and geometry\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int cache_save(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    size_t len = cache_export(blob, 0, sizeof(blob));
+
+    if (!f || fwrite(blob, 1, len, f) != len) {
+        perror(path);
+        if (f)
+            fclose(f);
+        return -1;
+    }
+    return fclose(f) ? -1 : 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s -a <engine:budget> -b <engine:budget> [-g games] "
+            "[-s seed] [-S board_size] [-G goal]\n"
+            "       [-c cache_file]\n"
+            "  engine:budget is mcts:<iterations>, negamax:<depth> or "
+            "pns:<nodes>\n"
+            "  cache_file keeps the positions solved by pns between runs\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct tournament t = {.games = 100, .seed = 1};
+    const char *a = NULL, *b = NULL, *cache_file = NULL;
+    char name_a[32], name_b[32];
+    int size = DEFAULT_BOARD_SIZE, goal = DEFAULT_GOAL;
+    int opt, score, ci;
+
+    while ((opt = getopt(argc, argv, "a:b:g:s:S:G:c:")) != -1) {
+        switch (opt) {
+        case 'a':
+            a = optarg;
+            break;
+        case 'b':
+            b = optarg;
+            break;
+        case 'g':
+            t.games = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            t.seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'S':
+            size = atoi(optarg);
+            break;
+        case 'G':
+            goal = atoi(optarg);
+            break;
+        case 'c':
+            cache_file = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (!a || !b || engine_config_parse(&t.a, a) ||
+        engine_config_parse(&t.b, b) || !t.games || game_configure(size, goal))
+        usage(argv[0]);
+
+    engines_init();
+    if (cache_file && cache_load(cache_file))
+        return 1;
+    tournament_run(&t);
+    if (cache_file && cache_save(cache_file))
+        return 1;
+    tournament_score(&t, &score, &ci);
+
+    engine_config_format(&t.a, name_a, sizeof(name_a));
+    engine_config_format(&t.b, name_b, sizeof(name_b));
+    printf("%s vs %s on %dx%d goal %d, %u games, seed %llu\n", name_a, name_b,
+           BOARD_SIZE, BOARD_SIZE, GOAL, t.played,
+           (unsigned long long) t.seed);
+    printf("  +%u =%u -%u  score %.1f%% +/- %.1f%%\n", t.wins, t.draws,
+           t.losses, score / 10.0, ci / 10.0);
+    for (int side = 0; side < 2; side++)
+        printf("  %-16s %8.3f ms/move over %llu moves\n",
+               side ? name_b : name_a,
+               t.moves[side] ? t.time_ns[side] / 1e6 / t.moves[side] : 0.0,
+               (unsigned long long) t.moves[side]);
+    if (cache_file)
+        printf("  cache: %lu hits, %lu misses, %lu stores\n", cache_stats.hits,
+               cache_stats.misses, cache_stats.stores);
+    return 0;
+}
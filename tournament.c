@@ -0,0 +1,138 @@
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+
+#include "game.h"
+#include "tournament.h"
+#include "xoroshiro128.h"
+
+/* Parse "mcts:<iterations>", "negamax:<depth>" or "pns:<nodes>" */
+int engine_config_parse(struct engine_config *cfg, const char *str)
+{
+    for (int i = 0; i < NR_ENGINES; i++) {
+        size_t len = strlen(engines[i]->name);
+        if (strncmp(str, engines[i]->name, len) || str[len] != ':')
+            continue;
+        if (sscanf(str + len + 1, "%d", &cfg->budget) != 1 ||
+            cfg->budget <= 0)
+            return -EINVAL;
+        cfg->engine = i;
+        return 0;
+    }
+    return -EINVAL;
+}
+
+int engine_config_format(const struct engine_config *cfg,
+                         char *buf,
+                         size_t size)
+{
+    return snprintf(buf, size, "%s:%d", engines[cfg->engine]->name,
+                    cfg->budget);
+}
+
+/* Plies played at random before the engines take over. Without them the
+ * deterministic engines would play the same game with each color.
+ */
+#define OPENING_PLIES 2
+
+static char play_game(struct tournament *t, bool a_is_x, unsigned int g)
+{
+    char table[N_GRIDS_MAX];
+    char player = 'X', win;
+
+    /* Both games of a pair share the opening, with the colors swapped */
+    memset(table, ' ', N_GRIDS);
+    xoro_seed(t->seed, 2654435761U + g / 2);
+    for (int ply = 0; ply < OPENING_PLIES && check_win(table) == ' '; ply++) {
+        int moves[N_GRIDS_MAX], n_moves = 0;
+
+        for_each_empty_grid (i, table)
+            moves[n_moves++] = i;
+        table[moves[xoro_next() % n_moves]] = player;
+        player ^= 'O' ^ 'X';
+    }
+
+    xoro_seed(t->seed, 1618033989 + g);
+    while ((win = check_win(table)) == ' ') {
+        int side = (player == 'X') != a_is_x;
+        u64 start = ktime_get_ns();
+        const struct engine_config *cfg = side ? &t->b : &t->a;
+        int move =
+            engine_search(cfg->engine, table, player, cfg->budget, t->stop);
+
+        t->time_ns[side] += ktime_get_ns() - start;
+        t->moves[side]++;
+        if (move < 0 || search_stopped(t->stop))
+            break;
+        table[move] = player;
+        player ^= 'O' ^ 'X';
+        cond_resched();
+    }
+    return win;
+}
+
+/* Play t->games games, a and b alternating the first move. Openings and
+ * rollouts are seeded from t->seed and the game number so that every run is
+ * reproducible.
+ */
+void tournament_run(struct tournament *t)
+{
+    engines_reset();
+    t->played = t->wins = t->draws = t->losses = 0;
+    memset(t->time_ns, 0, sizeof(t->time_ns));
+    memset(t->moves, 0, sizeof(t->moves));
+
+    for (unsigned int g = 0; g < t->games; g++) {
+        bool a_is_x = !(g & 1);
+        char win;
+
+        win = play_game(t, a_is_x, g);
+        /* An interrupted game is not counted */
+        if (search_stopped(t->stop))
+            break;
+        if (win == 'D' || win == ' ')
+            t->draws++;
+        else if ((win == 'X') == a_is_x)
+            t->wins++;
+        else
+            t->losses++;
+        t->played++;
+    }
+}
+
+static unsigned long isqrt(unsigned long x)
+{
+    unsigned long r = 0;
+    for (unsigned long bit = 1UL << (BITS_PER_LONG - 2); bit; bit >>= 2) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+    }
+    return r;
+}
+
+/* Score of a (win = 1, draw = 1/2) and the half-width of its 95% confidence
+ * interval, both in permille.
+ */
+void tournament_score(const struct tournament *t, int *score, int *ci)
+{
+    u64 n = t->played, mean, sq;
+
+    if (!n) {
+        *score = *ci = 0;
+        return;
+    }
+    mean = div64_u64((2ULL * t->wins + t->draws) * 500, n);
+    sq = div64_u64(t->wins * 1000000ULL + t->draws * 250000ULL, n);
+    *score = mean;
+    *ci = isqrt(div64_u64((sq - mean * mean) * 10000, n)) * 196 / 10000;
+}
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <linux/types.h>
+
+#include "engine.h"
+
+struct engine_config {
+    int engine; /* ENGINE_* */
+    int budget; /* MCTS iterations, negamax depth or pns nodes */
+};
+
+struct tournament {
+    struct engine_config a, b;
+    unsigned int games;
+    u64 seed;
+    const bool *stop; /* cancels the run, may be NULL */
+
+    /* Results from the point of view of a, updated after every game */
+    unsigned int played, wins, draws, losses;
+    u64 time_ns[2]; /* search time of a and b */
+    u64 moves[2];
+};
+
+int engine_config_parse(struct engine_config *cfg, const char *str);
+int engine_config_format(const struct engine_config *cfg,
+                         char *buf,
+                         size_t size);
+void tournament_run(struct tournament *t);
+void tournament_score(const struct tournament *t, int *score, int *ci);
@@ -7,7 +7,7 @@ static inline u64 rotl(const u64 x, int k)
     return (x << k) | (x >> (64 - k));
 }
 
-void seed(u64 s0, u64 s1)
+void xoro_seed(u64 s0, u64 s1)
 {
     s[0] = s0;
     s[1] = s1;
@@ -49,5 +49,5 @@ void jump(void)
 
 void xoro_init(void)
 {
-    seed(314159265, 1618033989);
+    xoro_seed(314159265, 1618033989);
 }
@@ -2,6 +2,7 @@
 
 #include <linux/slab.h>
 
+void xoro_seed(u64 s0, u64 s1);
 uint64_t xoro_next(void);
 void jump(void);
 void xoro_init(void);
@@ -1,75 +1,273 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
+#include <linux/string.h>
+#ifdef __KERNEL__
+#include <linux/shrinker.h>
+#include <linux/version.h>
+#endif
 
 #include "xoroshiro128.h"
 #include "zobrist.h"
 
-u64 zobrist_table[N_GRIDS][2];
+u64 zobrist_table[N_GRIDS_MAX][2];
 
-#define HASH(key) ((key) % HASH_TABLE_SIZE)
+/* Entries sharing a cache line */
+#define BUCKET_SIZE 4
 
-static struct hlist_head *hash_table;
+/* Entries of earlier searches are told apart by their generation, so
+ * clearing the table between searches is a counter bump.
+ */
+#define GEN_MASK 63
+
+static zobrist_entry_t *hash_table;
+static size_t n_buckets; /* a power of two, 0 without a table */
+static size_t tt_bytes = (size_t) TT_DEFAULT_KB << 10; /* requested size */
+static u8 generation = 1;
+static bool tt_ready;
+
+/* Held by a search, whose table may not be resized or released under it */
+static DEFINE_MUTEX(tt_lock);
+
+struct zobrist_stats zobrist_stats;
+
+/* Table of at most @bytes, in @buckets, or NULL */
+static zobrist_entry_t *tt_alloc(size_t bytes, size_t *buckets)
+{
+    size_t n = bytes / (BUCKET_SIZE * sizeof(zobrist_entry_t));
+
+    if (!n)
+        return NULL;
+    while (n & (n - 1))
+        n &= n - 1;
+    *buckets = n;
+    return kvcalloc(n * BUCKET_SIZE, sizeof(zobrist_entry_t),
+                    GFP_KERNEL | __GFP_NOWARN);
+}
+
+/* Called with tt_lock held */
+static void tt_install(zobrist_entry_t *table, size_t buckets)
+{
+    kvfree(hash_table);
+    hash_table = table;
+    n_buckets = table ? buckets : 0;
+    generation = 1;
+}
+
+#ifdef __KERNEL__
+/* Under memory pressure, free the table of an idle engine. The next search
+ * allocates it again, or runs without one if that fails.
+ */
+static unsigned long tt_count(struct shrinker *shrinker,
+                              struct shrink_control *sc)
+{
+    size_t pages = READ_ONCE(n_buckets) * BUCKET_SIZE *
+                   sizeof(zobrist_entry_t) >> PAGE_SHIFT;
+
+    return pages ?: SHRINK_EMPTY;
+}
+
+static unsigned long tt_scan(struct shrinker *shrinker,
+                             struct shrink_control *sc)
+{
+    unsigned long freed;
+
+    if (!mutex_trylock(&tt_lock))
+        return SHRINK_STOP;
+    freed = n_buckets * BUCKET_SIZE * sizeof(zobrist_entry_t) >> PAGE_SHIFT;
+    if (freed) {
+        tt_install(NULL, 0);
+        zobrist_stats.released++;
+    }
+    mutex_unlock(&tt_lock);
+    return freed;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+static struct shrinker *tt_shrinker;
+
+static void tt_shrinker_register(void)
+{
+    tt_shrinker = shrinker_alloc(0, "simrupt-tt");
+    if (!tt_shrinker) {
+        pr_warn("simrupt: transposition table shrinker not registered\n");
+        return;
+    }
+    tt_shrinker->count_objects = tt_count;
+    tt_shrinker->scan_objects = tt_scan;
+    shrinker_register(tt_shrinker);
+}
+
+static void tt_shrinker_unregister(void)
+{
+    shrinker_free(tt_shrinker);
+}
+#else
+static struct shrinker tt_shrinker = {
+    .count_objects = tt_count,
+    .scan_objects = tt_scan,
+    .seeks = DEFAULT_SEEKS,
+};
+static bool tt_shrinker_registered;
+
+static void tt_shrinker_register(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 0, 0)
+    tt_shrinker_registered = !register_shrinker(&tt_shrinker, "simrupt-tt");
+#else
+    tt_shrinker_registered = !register_shrinker(&tt_shrinker);
+#endif
+    if (!tt_shrinker_registered)
+        pr_warn("simrupt: transposition table shrinker not registered\n");
+}
+
+static void tt_shrinker_unregister(void)
+{
+    if (tt_shrinker_registered)
+        unregister_shrinker(&tt_shrinker);
+}
+#endif
+#else
+static void tt_shrinker_register(void) {}
+static void tt_shrinker_unregister(void) {}
+#endif
 
 void zobrist_init(void)
 {
+    zobrist_entry_t *table;
+    size_t buckets;
     int i;
     xoro_init();
-    for (i = 0; i < N_GRIDS; i++) {
+    for (i = 0; i < N_GRIDS_MAX; i++) {
         zobrist_table[i][0] = xoro_next();
         zobrist_table[i][1] = xoro_next();
         jump();
     }
-    hash_table =
-        kmalloc(sizeof(struct hlist_head) * HASH_TABLE_SIZE, GFP_KERNEL);
-    if (!hash_table) {
-        pr_info("simrupt: Failed to allocate space for hash_table\n");
-        return;
+    table = tt_alloc(tt_bytes, &buckets);
+    if (!table && tt_bytes)
+        pr_warn("simrupt: no memory for a %zu KiB transposition table\n",
+                tt_bytes >> 10);
+    tt_install(table, buckets);
+    tt_shrinker_register();
+    tt_ready = true;
+}
+
+void zobrist_exit(void)
+{
+    tt_shrinker_unregister();
+    tt_install(NULL, 0);
+    tt_ready = false;
+}
+
+/* Replace the table with one of @bytes, keeping the current one if it cannot
+ * be allocated. Before zobrist_init() only the size is recorded.
+ */
+int zobrist_resize(size_t bytes)
+{
+    zobrist_entry_t *table;
+    size_t buckets;
+
+    mutex_lock(&tt_lock);
+    if (tt_ready) {
+        table = tt_alloc(bytes, &buckets);
+        if (!table && bytes) {
+            mutex_unlock(&tt_lock);
+            return -ENOMEM;
+        }
+        tt_install(table, buckets);
     }
-    for (i = 0; i < HASH_TABLE_SIZE; i++)
-        INIT_HLIST_HEAD(&hash_table[i]);
+    tt_bytes = bytes;
+    mutex_unlock(&tt_lock);
+    return 0;
 }
 
-zobrist_entry_t *zobrist_get(u64 key)
+/* Requested size of the table in bytes */
+size_t zobrist_size(void)
 {
-    unsigned long long hash_key = HASH(key);
+    return READ_ONCE(tt_bytes);
+}
 
-    if (hlist_empty(&hash_table[hash_key]))
-        return NULL;
+/* Bytes of the table allocated now */
+size_t zobrist_memory(void)
+{
+    return READ_ONCE(n_buckets) * BUCKET_SIZE * sizeof(zobrist_entry_t);
+}
 
-    zobrist_entry_t *entry = NULL;
+/* Start a search, with the table empty */
+void zobrist_begin(void)
+{
+    mutex_lock(&tt_lock);
+    if (!hash_table && tt_bytes) {
+        size_t buckets;
+        zobrist_entry_t *table = tt_alloc(tt_bytes, &buckets);
 
-    hlist_for_each_entry (entry, &hash_table[hash_key], ht_list)
+        tt_install(table, buckets);
+    }
+}
 
-    {
-        if (entry->key == key)
-            return entry;
+void zobrist_end(void)
+{
+    generation = (generation + 1) & GEN_MASK;
+    if (!generation) {
+        memset(hash_table, 0,
+               n_buckets * BUCKET_SIZE * sizeof(zobrist_entry_t));
+        generation = 1;
     }
-    return NULL;
+    mutex_unlock(&tt_lock);
+}
+
+static inline zobrist_entry_t *bucket_of(u64 key)
+{
+    return &hash_table[(key & (n_buckets - 1)) * BUCKET_SIZE];
 }
 
-void zobrist_put(u64 key, int score, int move)
+zobrist_entry_t *zobrist_get(u64 key)
 {
-    unsigned long long hash_key = HASH(key);
-    zobrist_entry_t *new_entry = kmalloc(sizeof(zobrist_entry_t), GFP_KERNEL);
-    // assert(new_entry);
-    new_entry->key = key;
-    new_entry->move = move;
-    new_entry->score = score;
-    hlist_add_head(&new_entry->ht_list, &hash_table[hash_key]);
+    zobrist_entry_t *bucket;
+
+    zobrist_stats.lookups++;
+    if (unlikely(!n_buckets))
+        return NULL;
+
+    bucket = bucket_of(key);
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        if (bucket[i].gen == generation && bucket[i].key == key) {
+            zobrist_stats.hits++;
+            return &bucket[i];
+        }
+    }
+    return NULL;
 }
 
-void zobrist_clear(void)
+/* Overwrite the entry of @key, else a stale one, else the shallowest */
+void zobrist_put(u64 key,
+                 int score,
+                 int move,
+                 int depth,
+                 enum zobrist_bound bound)
 {
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        while (!hlist_empty(&hash_table[i])) {
-            zobrist_entry_t *entry;
-            entry = hlist_entry(hash_table[i].first, zobrist_entry_t, ht_list);
-            hlist_del(&entry->ht_list);
-            kfree(entry);
+    zobrist_entry_t *bucket, *victim = NULL;
+
+    if (unlikely(!n_buckets))
+        return;
+
+    bucket = bucket_of(key);
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        zobrist_entry_t *e = &bucket[i];
+        if (e->gen != generation || e->key == key) {
+            victim = e;
+            break;
         }
-        INIT_HLIST_HEAD(&hash_table[i]);
+        if (!victim || e->depth < victim->depth)
+            victim = e;
     }
+    victim->key = key;
+    victim->score = score;
+    victim->move = move;
+    victim->depth = depth;
+    victim->bound = bound;
+    victim->gen = generation;
 }
 
 MODULE_LICENSE("GPL");
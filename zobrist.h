@@ -1,25 +1,46 @@
 #pragma once
 
 #include <linux/kernel.h>
-#include <linux/list.h>
 #include <linux/module.h>
 #include <linux/types.h>
 
 #include "game.h"
 
+/* Default and largest size of the transposition table, in KiB */
+#define TT_DEFAULT_KB 1024
+#define TT_MAX_KB (256 * 1024)
 
-#define HASH_TABLE_SIZE (100003)  // choose a large prime number
+extern u64 zobrist_table[N_GRIDS_MAX][2];
 
-extern u64 zobrist_table[N_GRIDS][2];
+/* How the stored score relates to the true value of the position */
+enum zobrist_bound { TT_EXACT, TT_LOWER, TT_UPPER };
 
 typedef struct {
     u64 key;
     int score;
-    int move;
-    struct hlist_node ht_list;
+    s16 move;
+    u8 depth;
+    u8 bound : 2; /* enum zobrist_bound */
+    u8 gen : 6;   /* search that stored the entry */
 } zobrist_entry_t;
 
+struct zobrist_stats {
+    unsigned long lookups, hits;
+    unsigned long released; /* tables freed under memory pressure */
+};
+
+extern struct zobrist_stats zobrist_stats;
+
 void zobrist_init(void);
+void zobrist_exit(void);
+int zobrist_resize(size_t bytes);
+size_t zobrist_size(void);
+size_t zobrist_memory(void);
+void zobrist_begin(void);
+void zobrist_end(void);
 zobrist_entry_t *zobrist_get(u64 key);
-void zobrist_put(u64 key, int score, int move);
-void zobrist_clear(void);
+void zobrist_put(u64 key,
+                 int score,
+                 int move,
+                 int depth,
+                 enum zobrist_bound bound);